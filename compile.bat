@@ -1,3 +1,7 @@
 C:\\VulkanSDK\\1.4.304.1\\Bin\\glslc.exe triangle.vert -o vert.spv
 C:\\VulkanSDK\\1.4.304.1\\Bin\\glslc.exe triangle.frag -o frag.spv
+C:\\VulkanSDK\\1.4.304.1\\Bin\\glslc.exe instanced.vert -o instanced_vert.spv
+C:\\VulkanSDK\\1.4.304.1\\Bin\\glslc.exe cull.comp -o cull.spv
+C:\\VulkanSDK\\1.4.304.1\\Bin\\glslc.exe bindless.vert -o bindless_vert.spv
+C:\\VulkanSDK\\1.4.304.1\\Bin\\glslc.exe bindless.frag -o bindless_frag.spv
 pause
\ No newline at end of file
@@ -1,6 +1,10 @@
 ﻿#define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
@@ -12,11 +16,70 @@
 #include <limits>
 #include <optional>
 #include <set>
+#include <array>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <unordered_map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <atomic>
+
+#if !__has_include(<stb_image.h>)
+#error "PNG decoding needs stb_image.h (github.com/nothings/stb) on the include path"
+#endif
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#ifdef USE_SHADERC
+#include <shaderc/shaderc.hpp>
+#endif
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+//headless模式下未指定--frames时渲染的帧数
+const uint32_t DEFAULT_HEADLESS_FRAMES = 1000;
+//benchmark模式下未指定--warmup时的预热帧数
+const uint32_t DEFAULT_WARMUP_FRAMES = 60;
+//后台编译管线变体的线程数
+const uint32_t PIPELINE_COMPILE_THREADS = 2;
+//每帧描述符池的容量（集合数），不够时为该帧再创建一个池
+const uint32_t FRAME_DESCRIPTOR_SETS_PER_POOL = 16;
+//bindless描述符数组的大小，支持descriptor indexing的设备每阶段至少允许500000个
+const uint32_t BINDLESS_MAX_BUFFERS = 1024;
+const uint32_t BINDLESS_MAX_TEXTURES = 1024;
+//纹理加载：解码线程数和暂存环形缓冲区大小（单个纹理的全部mip级别必须放得下）
+const uint32_t TEXTURE_LOAD_THREADS = 2;
+const VkDeviceSize TEXTURE_STAGING_SIZE = 64 * 1024 * 1024;
+
+//每帧写入的时间戳：渲染通道开始/绘制开始/绘制结束/渲染通道结束
+enum TimestampQuery : uint32_t
+{
+	TIMESTAMP_PASS_BEGIN = 0,
+	TIMESTAMP_DRAW_BEGIN,
+	TIMESTAMP_DRAW_END,
+	TIMESTAMP_PASS_END,
+	TIMESTAMP_CULL_BEGIN,//剔除计算着色器前后，在渲染通道之前
+	TIMESTAMP_CULL_END,
+	TIMESTAMPS_PER_FRAME
+};
 
 //validation layer list
 const std::vector<const char*> validationLayers = {
@@ -54,640 +117,6306 @@ void DestroyDebugUtilsMessengerEXT( VkInstance instance, VkDebugUtilsMessengerEX
 	}
 }
 
-struct QueueFamilyIndices
+//命令行参数
+enum class DrawMode
 {
-	std::optional<uint32_t> graphicsFamily;
-	std::optional<uint32_t> presentFamily;
+	PerObject,//每个对象一次vkCmdDrawIndexed，常量通过动态uniform偏移选择
+	Instanced,//所有对象一次实例化绘制，每实例数据来自第二个顶点绑定
+	Indirect//计算着色器做视锥剔除并写入间接绘制命令，CPU只录制一次vkCmdDrawIndexedIndirect(Count)
+};
 
-	bool isComplete()
+const char* drawModeName( DrawMode mode )
+{
+	switch (mode)
 	{
-		return graphicsFamily.has_value() && presentFamily.has_value();
+	case DrawMode::Instanced:
+		return "instanced";
+	case DrawMode::Indirect:
+		return "indirect";
+	default:
+		return "per_object";
 	}
+}
+
+enum class SyncMode
+{
+	Fence,//每个帧槽位一个VkFence
+	Timeline//图形队列一个时间线信号量，帧i完成时值为i+1
 };
 
-struct SwapChainSupportDetails
+//帧节奏预设，决定呈现模式、交换链图像数和飞行帧数
+enum class FramePacing
 {
-	VkSurfaceCapabilitiesKHR capabilities;
-	std::vector<VkSurfaceFormatKHR> formats;
-	std::vector<VkPresentModeKHR> presentModes;
+	LowLatency,//1帧飞行，最少的交换链图像，优先MAILBOX/IMMEDIATE
+	Balanced,//2帧飞行，minImageCount + 1，优先MAILBOX
+	MaxThroughput//3帧飞行，minImageCount + 2，优先不等待垂直同步的IMMEDIATE
 };
 
-class HelloTriangleApplication
+struct FramePacingPolicy
 {
-public:
-	void run()
+	uint32_t framesInFlight;
+	uint32_t extraSwapChainImages;//在minImageCount之上额外请求的图像数
+	std::vector<VkPresentModeKHR> presentModes;//按优先级排列，都不支持时使用必定支持的FIFO
+};
+
+FramePacingPolicy getFramePacingPolicy( FramePacing pacing )
+{
+	switch (pacing)
 	{
-		initWindow();
-		initVulkan();
-		mainLoop();
-		cleanup();
+	case FramePacing::LowLatency:
+		return { 1, 0, { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR } };
+	case FramePacing::MaxThroughput:
+		return { 3, 2, { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR } };
+	default:
+		return { 2, 1, { VK_PRESENT_MODE_MAILBOX_KHR } };
 	}
+}
 
-private:
-	GLFWwindow* window;
-
-	VkInstance instance;
-	VkDebugUtilsMessengerEXT debugMessenger;
-	VkSurfaceKHR surface;
-	// physicalDevice将在销毁 VkInstance 时隐式销毁
-	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-	VkDevice device;//logical device
-	VkQueue graphicsQueue;
-	VkQueue presentQueue;
-	VkSwapchainKHR swapChain;
-	//swap chain image handle
-	//automatically destroyed after swap chain being destroyed
-	std::vector<VkImage> swapChainImages;
-	VkFormat swapChainImageFormat;
-	VkExtent2D swapChainExtent;//交换链图像尺寸
-	std::vector<VkImageView> swapChainImageViews;
-	std::vector<VkFramebuffer> swapChainFramebuffers;
-	VkRenderPass renderPass;
-	VkPipelineLayout pipelineLayout;
-	VkPipeline graphicsPipeline;
-	VkCommandPool commandPool;
-	std::vector<VkCommandBuffer> commandBuffers;
-	std::vector<VkSemaphore> imageAvailableSemaphores;//表示已从交换链获取图像并准备好进行渲染
-	std::vector<VkSemaphore> renderFinishedSemaphores;//表示渲染已完成并且可以进行呈现
-	std::vector<VkFence> inFlightFences;//确保一次只渲染一帧
-	uint32_t currentFrame = 0;
-	bool framebufferResized = false;
-
-	void initWindow()
+const char* framePacingName( FramePacing pacing )
+{
+	switch (pacing)
 	{
-		glfwInit();
-		//tell glfw do not use OPENGL
-		glfwWindowHint( GLFW_CLIENT_API, GLFW_NO_API );
-		//create window
-		window = glfwCreateWindow( WIDTH, HEIGHT, "Vulkan", nullptr, nullptr );
-		glfwSetWindowUserPointer( window, this );
-		glfwSetFramebufferSizeCallback( window, framebufferResizeCallback );//glfwPollEvents()触发事件
+	case FramePacing::LowLatency:
+		return "low_latency";
+	case FramePacing::MaxThroughput:
+		return "max_throughput";
+	default:
+		return "balanced";
 	}
+}
 
-	static void framebufferResizeCallback( GLFWwindow* window, int width, int height )
+const char* presentModeName( VkPresentModeKHR mode )
+{
+	switch (mode)
 	{
-		auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer( window ));
-		app->framebufferResized = true;
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "immediate";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "mailbox";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		return "fifo_relaxed";
+	default:
+		return "fifo";
 	}
+}
 
-	void initVulkan()
+enum class BlendMode
+{
+	Opaque,
+	Alpha,
+	Additive
+};
+
+const char* blendModeName( BlendMode mode )
+{
+	switch (mode)
 	{
-		createInstance();
-		setupDebugMessenger();
-		createSurface();
-		pickPhysicalDevice();
-		createLogicalDevice();
-		createSwapChain();
-		createImageViews();
-		createRenderPass();
-		createGraphicsPipeline();
-		createFramebuffers();
-		createCommandPool();
-		createCommandBuffers();
-		createSyncObjects();
+	case BlendMode::Alpha:
+		return "alpha";
+	case BlendMode::Additive:
+		return "additive";
+	default:
+		return "opaque";
 	}
+}
 
-	void mainLoop()
+struct AppConfig
+{
+	bool headless = false;//不创建窗口和交换链，渲染到离屏VkImage（用于CI/无显示器环境）
+	uint32_t frameCount = 0;//headless模式下渲染的帧数，0表示使用DEFAULT_HEADLESS_FRAMES
+	uint32_t warmupFrames = DEFAULT_WARMUP_FRAMES;//benchmark模式下不计入统计的预热帧
+	uint32_t benchmarkFrames = 0;//benchmark模式下统计的帧数，0表示不开启benchmark
+	std::string reportPath = "benchmark.json";//按扩展名输出.json或.csv
+	std::string pipelineCachePath = "pipeline_cache.bin";//为空表示不使用磁盘上的管线缓存
+	uint32_t gridSize = 0;//大于0时绘制gridSize*gridSize个四边形组成的网格，否则绘制一个三角形
+	uint32_t objectCount = 1;//场景中网格的实例数量，每个对象有自己的变换
+	DrawMode drawMode = DrawMode::PerObject;
+	float cameraZoom = 1.0f;//大于1时视口外的对象会被剔除
+	BlendMode blendMode = BlendMode::Opaque;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	uint32_t pipelineVariantInterval = 0;//大于0时每隔这么多帧切换到下一个混合/剔除变体，测试新管线带来的卡顿
+	bool asyncPipelineCompile = true;//缺失的管线变体在后台编译，就绪前使用基础管线
+	bool objectPushConstants = true;//逐对象常量用push constant传递，否则每次绘制重新绑定动态uniform偏移
+	bool bindless = false;//逐对象绘制时对象常量放在bindless缓冲区数组里，每次绘制只推送下标
+	std::string assetArchivePath;//资源归档，着色器和纹理优先从这里取
+	std::string writeAssetArchivePath;//把程序用到的资源打包到这个文件后退出
+	bool selfTest = false;//运行分配器和渲染图的CPU侧检查后退出
+	std::string texturePath;//材质纹理（PNG或KTX2），在后台加载，加载完成前采样占位纹理
+	bool compressedTextures = true;//关闭后块压缩纹理总是在CPU上解码成RGBA8，用来对比显存和上传时间
+	bool shaderHotReload = false;//监视着色器源文件，改动后重新编译并在帧边界替换管线
+	FramePacing pacing = FramePacing::Balanced;
+	uint32_t framesInFlight = 0;//大于0时覆盖预设的飞行帧数
+	SyncMode syncMode = SyncMode::Fence;
+	uint32_t syncSweepMax = 0;//大于0时两种同步模式分别用1到该值的飞行帧数各跑一次benchmark
+	bool pacingSweep = false;//三种帧节奏预设各跑一次benchmark
+	bool useTransferQueue = true;//有专用传输队列族时异步上传
+	bool dynamicRendering = false;//用vkCmdBeginRendering代替VkRenderPass/VkFramebuffer（需要Vulkan 1.3）
+	bool renderPathSweep = false;//两种渲染路径各跑一次benchmark
+	bool useAsyncCompute = true;//有独立计算队列族时，间接绘制的剔除在计算队列上与图形工作重叠执行
+	bool resizeWaitIdle = false;//重建交换链前vkDeviceWaitIdle（旧行为，用于对比卡顿）
+	uint32_t resizeInterval = 0;//窗口模式下大于0时每隔这么多帧自动改变一次窗口大小
+	uint32_t instanceSweepMax = 0;//大于0时两种绘制模式分别用1,10,100...到该对象数各跑一次benchmark
+	uint32_t recordThreads = 0;//大于0时由这么多工作线程并行录制二级命令缓冲区，0表示在主线程直接录制
+	uint32_t threadSweepMax = 0;//大于0时依次用0,1,2,4...到该线程数各跑一次benchmark
+};
+
+//交错存储的顶点数据，布局与triangle.vert中的输入一致
+struct Vertex
+{
+	glm::vec2 pos;
+	glm::vec3 color;
+
+	static VkVertexInputBindingDescription getBindingDescription()
 	{
-		while (!glfwWindowShouldClose( window ))
-		{
-			glfwPollEvents();
-			drawFrame();
-		}
+		VkVertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof( Vertex );
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;//逐顶点读取
 
-		vkDeviceWaitIdle( device );
+		return bindingDescription;
 	}
 
-	void cleanupSwapChain()
+	static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions()
 	{
-		for (auto framebuffer : swapChainFramebuffers)
-		{
-			vkDestroyFramebuffer( device, framebuffer, nullptr );
-		}
+		std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
 
-		for (auto imageView : swapChainImageViews)
-		{
-			vkDestroyImageView( device, imageView, nullptr );
-		}
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;//layout(location = 0) in vec2 inPosition
+		attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+		attributeDescriptions[0].offset = offsetof( Vertex, pos );
 
-		vkDestroySwapchainKHR( device, swapChain, nullptr );
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = 1;//layout(location = 1) in vec3 inColor
+		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescriptions[1].offset = offsetof( Vertex, color );
+
+		return attributeDescriptions;
 	}
+};
 
-	void cleanup()
-	{
-		cleanupSwapChain();
+//由应用程序提供的网格
+struct Mesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+};
 
-		vkDestroyPipeline( device, graphicsPipeline, nullptr );
-		vkDestroyPipelineLayout( device, pipelineLayout, nullptr );
+//场景中的一个对象：同一个网格的一份带变换和颜色的拷贝
+struct SceneObject
+{
+	glm::vec2 position = glm::vec2( 0.0f );
+	float scale = 1.0f;
+	float rotationSpeed = 0.0f;//弧度/秒
+	glm::vec4 color = glm::vec4( 1.0f );
+};
 
-		vkDestroyRenderPass( device, renderPass, nullptr );
+//实例化绘制时每个对象的顶点数据（binding 1，按实例步进），旋转在instanced.vert中计算
+struct InstanceData
+{
+	glm::vec4 transform;//xy: 位置，z: 缩放，w: 旋转角（弧度）
+	glm::vec4 color;
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-		{
-			vkDestroySemaphore( device, renderFinishedSemaphores[i], nullptr );
-			vkDestroySemaphore( device, imageAvailableSemaphores[i], nullptr );
-			vkDestroyFence( device, inFlightFences[i], nullptr );
-		}
+	static VkVertexInputBindingDescription getBindingDescription()
+	{
+		VkVertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = 1;
+		bindingDescription.stride = sizeof( InstanceData );
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
-		vkDestroyCommandPool( device, commandPool, nullptr );
+		return bindingDescription;
+	}
 
-		vkDestroyDevice( device, nullptr );
+	static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions()
+	{
+		std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
 
-		if (enableValidationLayers)
-		{
-			DestroyDebugUtilsMessengerEXT( instance, debugMessenger, nullptr );
-		}
+		attributeDescriptions[0].binding = 1;
+		attributeDescriptions[0].location = 2;
+		attributeDescriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescriptions[0].offset = offsetof( InstanceData, transform );
 
-		vkDestroySurfaceKHR( instance, surface, nullptr );
-		vkDestroyInstance( instance, nullptr );
+		attributeDescriptions[1].binding = 1;
+		attributeDescriptions[1].location = 3;
+		attributeDescriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescriptions[1].offset = offsetof( InstanceData, color );
+
+		return attributeDescriptions;
+	}
+};
+
+//cull.comp的push constant，布局与着色器一致
+struct CullConstants
+{
+	glm::vec4 frustumPlanes[6];//xyz: 法线，w: 距离，包围球在所有平面内侧（或相交）时可见
+	uint32_t objectCount;
+	uint32_t indexCount;
+	float boundingRadius;//网格在缩放为1时的包围球半径
+	uint32_t compact;//1: 可见对象紧密写入并用drawCount计数，0: 原位写入，被剔除的instanceCount为0
+};
 
-		glfwDestroyWindow( window );
+//间接绘制缓冲区每帧区域的开头是可见数量（vkCmdDrawIndexedIndirectCount的count），之后是绘制命令
+const VkDeviceSize DRAW_COMMANDS_OFFSET = 16;
 
-		glfwTerminate();
+//从viewProj提取视锥的6个平面（Gribb/Hartmann），深度范围为Vulkan的[0, 1]
+void extractFrustumPlanes( const glm::mat4& viewProj, glm::vec4 planes[6] )
+{
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4( viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i] );
 	}
 
-	void recreateSwapChain()
+	planes[0] = rows[3] + rows[0];//左
+	planes[1] = rows[3] - rows[0];//右
+	planes[2] = rows[3] + rows[1];//下
+	planes[3] = rows[3] - rows[1];//上
+	planes[4] = rows[2];//近
+	planes[5] = rows[3] - rows[2];//远
+	for (int i = 0; i < 6; i++)
 	{
-		int width = 0, height = 0;
-		glfwGetFramebufferSize( window, &width, &height );
-		while (width == 0 || height == 0)
-		{
-			glfwGetFramebufferSize( window, &width, &height );
-			glfwWaitEvents();//阻塞，直到事件队列中有新的事件
-		}
+		float length = std::sqrt( planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z );
+		planes[i] = planes[i] / length;
+	}
+}
 
-		vkDeviceWaitIdle( device );
+struct Scene
+{
+	Mesh mesh;
+	std::vector<SceneObject> objects;
+};
 
-		cleanupSwapChain();
+//每帧写入上传环形缓冲区的常量，布局与triangle.vert中的uniform块一致（std140）
+struct FrameConstants
+{
+	glm::mat4 viewProj;
+	glm::vec4 params;//x: 时间（秒）
+};
 
-		createSwapChain();
-		createImageViews();
-		createFramebuffers();
-	}
+//push constant模式下作为每次绘制的push constant，否则放在上传环形缓冲区
+struct ObjectConstants
+{
+	glm::mat4 model;
+	glm::vec4 color;
+};
 
-	void createInstance()
-	{
-		// 检查验证层是否有效
-		if (enableValidationLayers && !checkValidationLayerSupport())
-		{
-			throw std::runtime_error( "validation layers requested, but not available!" );
-		}
-		// 填写appInfo和instanceInfo结构体
-		VkApplicationInfo appInfo{};
-		appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-		appInfo.pApplicationName = "Hello Triangle";
-		appInfo.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
-		appInfo.pEngineName = "No Engine";
-		appInfo.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+//bindless模式下每次绘制的push constant，和ObjectConstants共用同一个push constant范围
+struct BindlessDrawConstants
+{
+	uint32_t objectBuffer;//bindless缓冲区数组中的下标
+	uint32_t objectOffset;//以vec4为单位：模型矩阵的四列之后是颜色
+	uint32_t texture;//bindless纹理数组中的下标，片元着色器使用
+};
 
-		VkInstanceCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-		createInfo.pApplicationInfo = &appInfo;
-		// 获取扩展
-		auto extensions = getRequiredExtensions();
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-		createInfo.ppEnabledExtensionNames = extensions.data();
+//特化常量的constant_id，与着色器中的声明一致
+enum SpecializationConstant : uint32_t
+{
+	SPEC_OBJECT_PUSH_CONSTANTS = 0,//triangle.vert：逐对象常量来自push constant还是uniform块
+	SPEC_OUTPUT_ALPHA = 1,//triangle.frag：输出的alpha，混合变体用它做半透明
+	SPEC_CONSTANT_COUNT
+};
 
-		// 为instance创建和销毁过程创建单独的debug messenger
-		VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-		if (enableValidationLayers)
-		{
-			createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());//only one validation layer
-			createInfo.ppEnabledLayerNames = validationLayers.data();
+Mesh makeTriangleMesh()
+{
+	Mesh mesh;
+	mesh.vertices = {
+		{ { 0.0f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+		{ { 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f } },
+		{ { -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f } }
+	};
+	mesh.indices = { 0, 1, 2 };
+	return mesh;
+}
 
-			populateDebugMessengerCreateInfo( debugCreateInfo );
-			// 通过将指向 VkDebugUtilsMessengerCreateInfoEXT 结构的指针传递到 VkInstanceCreateInfo 的 pNext 扩展字段中，
-			// 为 vkCreateInstance 和 vkDestroyInstance 提供专门的调试支持
-			createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
-		}
-		else
-		{
-			createInfo.enabledLayerCount = 0;
+//cellsPerSide*cellsPerSide个四边形铺满视口中央，用来按规模压测顶点/索引路径
+Mesh makeGridMesh( uint32_t cellsPerSide )
+{
+	Mesh mesh;
+	uint32_t verticesPerSide = cellsPerSide + 1;
+	mesh.vertices.reserve( verticesPerSide * verticesPerSide );
+	mesh.indices.reserve( cellsPerSide * cellsPerSide * 6 );
 
-			createInfo.pNext = nullptr;
-		}
-		// 创建Vulkan实例
-		if (vkCreateInstance( &createInfo, nullptr, &instance ) != VK_SUCCESS)
+	for (uint32_t y = 0; y < verticesPerSide; y++)
+	{
+		for (uint32_t x = 0; x < verticesPerSide; x++)
 		{
-			throw std::runtime_error( "failed to create instance!" );
+			float u = static_cast<float>(x) / cellsPerSide;
+			float v = static_cast<float>(y) / cellsPerSide;
+			mesh.vertices.push_back( { { -0.9f + 1.8f * u, -0.9f + 1.8f * v }, { u, v, 1.0f - u } } );
 		}
 	}
 
-	void populateDebugMessengerCreateInfo( VkDebugUtilsMessengerCreateInfoEXT& createInfo )
+	for (uint32_t y = 0; y < cellsPerSide; y++)
 	{
-		createInfo = {};
-		createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-		createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-		createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-		createInfo.pfnUserCallback = debugCallback;
+		for (uint32_t x = 0; x < cellsPerSide; x++)
+		{
+			uint32_t topLeft = y * verticesPerSide + x;
+			uint32_t topRight = topLeft + 1;
+			uint32_t bottomLeft = topLeft + verticesPerSide;
+			uint32_t bottomRight = bottomLeft + 1;
+			//屏幕上顺时针，与VK_FRONT_FACE_CLOCKWISE一致
+			mesh.indices.insert( mesh.indices.end(), { topLeft, topRight, bottomRight, topLeft, bottomRight, bottomLeft } );
+		}
 	}
 
-	void setupDebugMessenger()
+	return mesh;
+}
+
+//count个对象排成正方形阵列铺满视口；只有一个对象时与原来的单个网格完全一致
+std::vector<SceneObject> makeObjectGrid( uint32_t count )
+{
+	std::vector<SceneObject> objects( count );
+	if (count <= 1)
 	{
-		if (!enableValidationLayers)
-			return;
-		// 填写debug messenger create info
-		VkDebugUtilsMessengerCreateInfoEXT createInfo;
-		populateDebugMessengerCreateInfo( createInfo );
-		// 创建debug messenger
-		if (CreateDebugUtilsMessengerEXT( instance, &createInfo, nullptr, &debugMessenger ) != VK_SUCCESS)
-		{
-			throw std::runtime_error( "failed to set up debug messenger!" );
-		}
+		return objects;
 	}
 
-	void createSurface()
+	uint32_t perRow = static_cast<uint32_t>(std::ceil( std::sqrt( static_cast<double>(count) ) ));
+	float cellSize = 2.0f / perRow;
+	for (uint32_t i = 0; i < count; i++)
 	{
-		if (glfwCreateWindowSurface( instance, window, nullptr, &surface ) != VK_SUCCESS)
-		{
-			throw std::runtime_error( "failed to create window surface!" );
-		}
+		uint32_t column = i % perRow;
+		uint32_t row = i / perRow;
+
+		SceneObject& object = objects[i];
+		object.position = glm::vec2( -1.0f + cellSize * (column + 0.5f), -1.0f + cellSize * (row + 0.5f) );
+		object.scale = cellSize * 0.5f;
+		object.rotationSpeed = 0.5f + static_cast<float>(i % 7) * 0.25f;
+		object.color = glm::vec4( 0.5f + 0.5f * column / perRow, 0.5f + 0.5f * row / perRow, 1.0f, 1.0f );
 	}
+	return objects;
+}
 
-	void pickPhysicalDevice()
+struct QueueFamilyIndices
+{
+	std::optional<uint32_t> graphicsFamily;
+	std::optional<uint32_t> presentFamily;
+	std::optional<uint32_t> transferFamily;//只支持传输的队列族（DMA引擎），可选
+	std::optional<uint32_t> computeFamily;//支持计算但不支持图形的队列族（异步计算），可选
+
+	//headless模式不需要呈现队列
+	bool isComplete( bool needPresent = true )
 	{
-		// get available device number
-		uint32_t deviceCount = 0;
-		vkEnumeratePhysicalDevices( instance, &deviceCount, nullptr );
+		return graphicsFamily.has_value() && (presentFamily.has_value() || !needPresent);
+	}
+};
 
-		if (deviceCount == 0)
-		{
-			throw std::runtime_error( "failed to find GPUs with Vulkan support!" );
-		}
-		// get available devices
-		std::vector<VkPhysicalDevice> devices( deviceCount );
-		vkEnumeratePhysicalDevices( instance, &deviceCount, devices.data() );
-		// check if device suitable
-		for (const auto& device : devices)
-		{
-			if (isDeviceSuitable( device ))
-			{
-				physicalDevice = device;
-				break;
-			}
-		}
+struct SwapChainSupportDetails
+{
+	VkSurfaceCapabilitiesKHR capabilities;
+	std::vector<VkSurfaceFormatKHR> formats;
+	std::vector<VkPresentModeKHR> presentModes;
+};
 
-		if (physicalDevice == VK_NULL_HANDLE)
-		{
-			throw std::runtime_error( "failed to find a suitable GPU!" );
-		}
+//drawFrame各阶段的CPU耗时（毫秒）
+struct FrameTimings
+{
+	double fenceWait = 0.0;//vkWaitForFences
+	double acquire = 0.0;//vkAcquireNextImageKHR
+	double record = 0.0;//重置并录制命令缓冲
+	double submit = 0.0;//vkQueueSubmit
+	double present = 0.0;//vkQueuePresentKHR
+	double inputToPresent = 0.0;//从glfwPollEvents采样输入到vkQueuePresentKHR返回
+	double total = 0.0;//整个drawFrame
+	//GPU时间戳，晚maxFramesInFlight帧回读后填入
+	double gpuRenderPass = 0.0;
+	double gpuDraw = 0.0;
+	double gpuCull = 0.0;
+};
+
+struct TimingStats
+{
+	double min = 0.0;
+	double max = 0.0;
+	double mean = 0.0;
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+};
+
+//最近秩法求百分位，samples会被排序
+TimingStats computeTimingStats( std::vector<double> samples )
+{
+	TimingStats stats;
+	if (samples.empty())
+	{
+		return stats;
 	}
 
-	void createLogicalDevice()
+	std::sort( samples.begin(), samples.end() );
+
+	auto percentile = [&samples]( double p )
 	{
-		// 查找并筛选物理设备支持的队列族中哪些支持指定的特性
-		QueueFamilyIndices indices = findQueueFamilies( physicalDevice );
+		size_t rank = static_cast<size_t>(std::ceil( p / 100.0 * samples.size() ));
+		return samples[std::clamp<size_t>( rank, 1, samples.size() ) - 1];
+	};
 
-		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-		std::set<uint32_t> uniqueQueueFamilies = {
-			indices.graphicsFamily.value(),
-			indices.presentFamily.value()
-		};
+	double sum = 0.0;
+	for (double sample : samples)
+	{
+		sum += sample;
+	}
 
-		float queuePriority = 1.0f;
-		//populate queueCreateInfo for all queueFamilies.
-		for (uint32_t queueFamily : uniqueQueueFamilies)
+	stats.min = samples.front();
+	stats.max = samples.back();
+	stats.mean = sum / samples.size();
+	stats.p50 = percentile( 50.0 );
+	stats.p95 = percentile( 95.0 );
+	stats.p99 = percentile( 99.0 );
+	return stats;
+}
+
+typedef std::vector<std::pair<std::string, std::string>> ReportInfo;//报告头部的键值对（设备、模式等）
+typedef std::vector<std::pair<std::string, TimingStats>> ReportMetrics;
+
+std::string escapeJson( const std::string& text )
+{
+	std::string escaped;
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
 		{
-			VkDeviceQueueCreateInfo queueCreateInfo{};
-			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queueCreateInfo.queueFamilyIndex = queueFamily;
-			queueCreateInfo.queueCount = 1;
-			queueCreateInfo.pQueuePriorities = &queuePriority;
-			queueCreateInfos.push_back( queueCreateInfo );
+			escaped += '\\';
 		}
+		escaped += c;
+	}
+	return escaped;
+}
 
-		VkPhysicalDeviceFeatures deviceFeatures{};
-		//populate logical device create info
-		VkDeviceCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+void writeReportJson( std::ostream& out, const ReportInfo& info, const ReportMetrics& metrics )
+{
+	out << "{\n";
+	for (const auto& [key, value] : info)
+	{
+		out << "  \"" << key << "\": \"" << escapeJson( value ) << "\",\n";
+	}
+	out << "  \"metrics\": {\n";
+	for (size_t i = 0; i < metrics.size(); i++)
+	{
+		const TimingStats& stats = metrics[i].second;
+		out << "    \"" << metrics[i].first << "\": { "
+			<< "\"min\": " << stats.min << ", \"max\": " << stats.max << ", \"mean\": " << stats.mean << ", "
+			<< "\"p50\": " << stats.p50 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << " }"
+			<< (i + 1 < metrics.size() ? "," : "") << "\n";
+	}
+	out << "  }\n}\n";
+}
 
-		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-		createInfo.pQueueCreateInfos = queueCreateInfos.data();
+void writeReportCsv( std::ostream& out, const ReportInfo& info, const ReportMetrics& metrics )
+{
+	for (const auto& [key, value] : info)
+	{
+		out << "# " << key << "=" << value << "\n";
+	}
+	out << "metric,min,max,mean,p50,p95,p99\n";
+	for (const auto& [name, stats] : metrics)
+	{
+		out << name << "," << stats.min << "," << stats.max << "," << stats.mean << ","
+			<< stats.p50 << "," << stats.p95 << "," << stats.p99 << "\n";
+	}
+}
 
-		createInfo.pEnabledFeatures = &deviceFeatures;
+VkDeviceSize alignUp( VkDeviceSize value, VkDeviceSize alignment )
+{
+	return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
 
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
-		//create logical device
-		if (vkCreateDevice( physicalDevice, &createInfo, nullptr, &device ) != VK_SUCCESS)
-		{
-			throw std::runtime_error( "failed to create logical device!" );
-		}
-		//获得队列句柄
-		vkGetDeviceQueue( device, indices.graphicsFamily.value(), 0, &graphicsQueue );
-		vkGetDeviceQueue( device, indices.presentFamily.value(), 0, &presentQueue );
+//[0, capacity)区间上的free list分配器（best fit，释放时与相邻空闲区合并），不涉及Vulkan调用
+class FreeListRange
+{
+public:
+	void init( VkDeviceSize size )
+	{
+		capacity = size;
+		used = 0;
+		freeRanges.clear();
+		freeRanges[0] = size;
 	}
 
-	void createSwapChain()
+	bool allocate( VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset )
 	{
-		//get swapChain support details
-		SwapChainSupportDetails swapChainSupport = querySwapChainSupport( physicalDevice );
+		auto best = freeRanges.end();
+		for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+		{
+			VkDeviceSize padding = alignUp( it->first, alignment ) - it->first;
+			if (it->second >= padding + size && (best == freeRanges.end() || it->second < best->second))
+			{
+				best = it;
+			}
+		}
+		if (best == freeRanges.end())
+		{
+			return false;
+		}
 
-		//choose the specified(the best) stuff
-		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat( swapChainSupport.formats );
-		VkPresentModeKHR presentMode = chooseSwapPresentMode( swapChainSupport.presentModes );
-		VkExtent2D extent = chooseSwapExtent( swapChainSupport.capabilities );
+		VkDeviceSize rangeOffset = best->first;
+		VkDeviceSize rangeSize = best->second;
+		offset = alignUp( rangeOffset, alignment );
+		freeRanges.erase( best );
 
-		//imageCount, i.e. buffer count in swapChain
-		uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-		//限制imagecount小于最大imagecount
-		//capabilities.maxImageCount==0时表示没有最大限制
-		if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
+		//对齐产生的前部空隙和尾部剩余仍然是空闲区
+		if (offset > rangeOffset)
 		{
-			imageCount = swapChainSupport.capabilities.maxImageCount;
+			freeRanges[rangeOffset] = offset - rangeOffset;
+		}
+		if (rangeOffset + rangeSize > offset + size)
+		{
+			freeRanges[offset + size] = rangeOffset + rangeSize - (offset + size);
 		}
 
-		VkSwapchainCreateInfoKHR createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-		createInfo.surface = surface;
-		//最终的image count由VULKAN驱动决定，程序员只需要限制image count的范围
-		createInfo.minImageCount = imageCount;
-		createInfo.imageFormat = surfaceFormat.format;
-		createInfo.imageColorSpace = surfaceFormat.colorSpace;
-		createInfo.imageExtent = extent;
-		createInfo.imageArrayLayers = 1;
-		createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		used += size;
+		return true;
+	}
 
-		QueueFamilyIndices indices = findQueueFamilies( physicalDevice );
-		uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	void free( VkDeviceSize offset, VkDeviceSize size )
+	{
+		used -= size;
 
-		if (indices.graphicsFamily != indices.presentFamily)
+		auto it = freeRanges.emplace( offset, size ).first;
+		//与后一个空闲区合并
+		auto next = std::next( it );
+		if (next != freeRanges.end() && it->first + it->second == next->first)
 		{
-			createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-			createInfo.queueFamilyIndexCount = 2;
-			createInfo.pQueueFamilyIndices = queueFamilyIndices;//指定数组内两个队列族共享所有权
+			it->second += next->second;
+			freeRanges.erase( next );
 		}
-		else
+		//与前一个空闲区合并
+		if (it != freeRanges.begin())
 		{
-			createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			auto prev = std::prev( it );
+			if (prev->first + prev->second == it->first)
+			{
+				prev->second += it->second;
+				freeRanges.erase( it );
+			}
 		}
+	}
 
-		createInfo.preTransform = swapChainSupport.capabilities.currentTransform;//交换链中图像变换
-		createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-		createInfo.presentMode = presentMode;
-		createInfo.clipped = VK_TRUE;
-
-		createInfo.oldSwapchain = VK_NULL_HANDLE;
+	VkDeviceSize getCapacity() const { return capacity; }
+	VkDeviceSize getUsed() const { return used; }
+	bool isEmpty() const { return used == 0; }
 
-		if (vkCreateSwapchainKHR( device, &createInfo, nullptr, &swapChain ) != VK_SUCCESS)
+	VkDeviceSize largestFreeRange() const
+	{
+		VkDeviceSize largest = 0;
+		for (const auto& range : freeRanges)
 		{
-			throw std::runtime_error( "failed to create swap chain!" );
+			largest = std::max( largest, range.second );
 		}
-		//get swap chain image count
-		vkGetSwapchainImagesKHR( device, swapChain, &imageCount, nullptr );
-		swapChainImages.resize( imageCount );
-		//get swap chain image handle
-		vkGetSwapchainImagesKHR( device, swapChain, &imageCount, swapChainImages.data() );
+		return largest;
+	}
 
-		swapChainImageFormat = surfaceFormat.format;
-		swapChainExtent = extent;
+private:
+	VkDeviceSize capacity = 0;
+	VkDeviceSize used = 0;
+	std::map<VkDeviceSize, VkDeviceSize> freeRanges;//offset -> size，按offset排序方便合并
+};
+
+//线性（bump）分配器，整体reset，用于每帧的临时数据
+class LinearRange
+{
+public:
+	void init( VkDeviceSize size )
+	{
+		capacity = size;
+		head = 0;
 	}
 
-	void createImageViews()
+	bool allocate( VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset )
 	{
-		//调整视图数量等于交换链图像数量
-		swapChainImageViews.resize( swapChainImages.size() );
-		//遍历所有交换链图像，填写create info
-		for (size_t i = 0; i < swapChainImages.size(); i++)
+		VkDeviceSize aligned = alignUp( head, alignment );
+		if (aligned + size > capacity)
 		{
-			VkImageViewCreateInfo createInfo{};
-			createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			createInfo.image = swapChainImages[i];
-			createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			createInfo.format = swapChainImageFormat;
-			createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-			createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-			createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-			createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-			createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			createInfo.subresourceRange.baseMipLevel = 0;
-			createInfo.subresourceRange.levelCount = 1;
-			createInfo.subresourceRange.baseArrayLayer = 0;
-			createInfo.subresourceRange.layerCount = 1;
+			return false;
+		}
+		offset = aligned;
+		head = aligned + size;
+		return true;
+	}
 
-			if (vkCreateImageView( device, &createInfo, nullptr, &swapChainImageViews[i] ) != VK_SUCCESS)
+	void reset() { head = 0; }
+
+	VkDeviceSize getCapacity() const { return capacity; }
+	VkDeviceSize getUsed() const { return head; }
+
+private:
+	VkDeviceSize capacity = 0;
+	VkDeviceSize head = 0;
+};
+
+//线性资源（缓冲区）和非线性资源（OPTIMAL图像）。bufferImageGranularity大于1时
+//两者放在不同的内存块里，相邻的子分配就永远不会违反粒度要求
+enum class GpuResourceKind
+{
+	Buffer,
+	Image
+};
+
+struct GpuMemoryBlock
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	uint32_t memoryType = 0;
+	GpuResourceKind kind = GpuResourceKind::Buffer;
+	bool dedicated = false;//超大的资源单独占一块
+	char* mapped = nullptr;//host visible的块在创建时持久映射
+	FreeListRange freeList;//长期资源
+	LinearRange linear;//每帧资源
+};
+
+struct GpuAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr;//已加上offset；非host visible内存为空
+	GpuMemoryBlock* block = nullptr;
+	bool frameLifetime = false;//每帧分配不需要单独释放
+};
+
+struct GpuAllocatorStats
+{
+	uint32_t blockCount = 0;//vkAllocateMemory次数
+	uint32_t allocationCount = 0;
+	VkDeviceSize bytesReserved = 0;
+	VkDeviceSize bytesUsed = 0;
+	double fragmentation = 0.0;//1 - 最大空闲区/总空闲，0表示空闲内存是连续的
+};
+
+//GPU内存子分配器：按内存类型申请大块VkDeviceMemory再切分，
+//避免每个资源一次vkAllocateMemory（慢，且受maxMemoryAllocationCount限制）
+class GpuAllocator
+{
+public:
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+	static constexpr VkDeviceSize FRAME_BLOCK_SIZE = 4ull * 1024 * 1024;
+
+	void init( VkPhysicalDevice physicalDevice, VkDevice device, uint32_t frameCount )
+	{
+		VkPhysicalDeviceMemoryProperties deviceMemProperties;
+		vkGetPhysicalDeviceMemoryProperties( physicalDevice, &deviceMemProperties );
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties( physicalDevice, &properties );
+		init( device, deviceMemProperties, properties.limits.bufferImageGranularity, properties.limits.maxMemoryAllocationCount, frameCount );
+	}
+
+	//device为VK_NULL_HANDLE时只做簿记，不创建VkDeviceMemory，自测用它在没有GPU的情况下检查分配策略
+	void init( VkDevice device, const VkPhysicalDeviceMemoryProperties& memProperties, VkDeviceSize bufferImageGranularity,
+		uint32_t maxAllocationCount, uint32_t frameCount )
+	{
+		this->device = device;
+		this->memProperties = memProperties;
+		this->bufferImageGranularity = bufferImageGranularity;
+		this->maxAllocationCount = maxAllocationCount;
+
+		frameBlocks.resize( frameCount );
+	}
+
+	void destroy()
+	{
+		for (auto& block : blocks)
+		{
+			freeBlockMemory( *block );
+		}
+		for (auto& slot : frameBlocks)
+		{
+			for (auto& block : slot)
 			{
-				throw std::runtime_error( "failed to create image views!" );
+				freeBlockMemory( *block );
 			}
 		}
+		blocks.clear();
+		frameBlocks.clear();
+		deviceMemoryCount = 0;
+		allocationCount = 0;
 	}
 
-	void createRenderPass()
+	uint32_t findMemoryType( uint32_t typeFilter, VkMemoryPropertyFlags properties ) const
 	{
-		//缓冲区附件
-		VkAttachmentDescription colorAttachment{};
-		colorAttachment.format = swapChainImageFormat;
-		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		//指定颜色和深度数据该如何处理
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;//渲染前
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;//渲染后
-		//指定模板数据该如何处理
-		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;//渲染前
-		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;//渲染后
-		//指定内存中像素布局
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;//渲染前
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;//渲染后
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+		{
+			if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return i;
+			}
+		}
 
-		VkAttachmentReference colorAttachmentRef{};
-		colorAttachmentRef.attachment = 0;//引用attachment discription
-		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;//附件在使用此引用的子过程期间具有的布局
+		throw std::runtime_error( "failed to find suitable memory type!" );
+	}
 
-		VkSubpassDescription subpass{};
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &colorAttachmentRef; //此数组中附件的索引直接从片段着色器使用 layout( location = 0 ) out vec4 outColor 指令引用！
+	GpuAllocation allocate( const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, GpuResourceKind kind )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
 
-		VkSubpassDependency dependency{};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;//上一个执行的subpass，（渲染通道之前或之后的隐式子通道）
-		dependency.dstSubpass = 0;//当前subpass
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;//需等待的操作发生的阶段
-		dependency.srcAccessMask = 0;//需等待的操作（0表示任意操作，我们不关心）
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;//当前subpass要执行的操作处于的阶段
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;//当前subpas要执行的操作
+		uint32_t memoryType = findMemoryType( requirements.memoryTypeBits, properties );
+		if (bufferImageGranularity <= 1)
+		{
+			kind = GpuResourceKind::Buffer;//不需要区分，共享同一组块
+		}
 
-		VkRenderPassCreateInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassInfo.attachmentCount = 1;
-		renderPassInfo.pAttachments = &colorAttachment;
-		renderPassInfo.subpassCount = 1;
-		renderPassInfo.pSubpasses = &subpass;
-		renderPassInfo.dependencyCount = 1;
-		renderPassInfo.pDependencies = &dependency;
+		VkDeviceSize offset = 0;
+		VkDeviceSize blockSize = preferredBlockSize( memoryType );
+		if (requirements.size > blockSize / 2)
+		{
+			GpuMemoryBlock* block = createBlock( memoryType, requirements.size, kind, blocks );
+			block->dedicated = true;
+			block->freeList.allocate( requirements.size, 1, offset );
+			return makeAllocation( block, offset, requirements.size, false );
+		}
 
-		if (vkCreateRenderPass( device, &renderPassInfo, nullptr, &renderPass ) != VK_SUCCESS)
+		for (auto& block : blocks)
 		{
-			throw std::runtime_error( "failed to create render pass!" );
+			if (!block->dedicated && block->memoryType == memoryType && block->kind == kind &&
+				block->freeList.allocate( requirements.size, requirements.alignment, offset ))
+			{
+				return makeAllocation( block.get(), offset, requirements.size, false );
+			}
 		}
+
+		GpuMemoryBlock* block = createBlock( memoryType, blockSize, kind, blocks );
+		block->freeList.allocate( requirements.size, requirements.alignment, offset );
+		return makeAllocation( block, offset, requirements.size, false );
 	}
 
-	void createGraphicsPipeline()
+	//分配只在frameSlot这一帧内使用的内存，下次beginFrame( frameSlot )时整体回收
+	GpuAllocation allocateFrame( const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, uint32_t frameSlot )
 	{
-		//管线可编程功能：
-		auto vertShaderCode = readFile( "shaders/vert.spv" );
-		auto fragShaderCode = readFile( "shaders/frag.spv" );
+		std::lock_guard<std::mutex> lock( mutex );
 
-		VkShaderModule vertShaderModule = createShaderModule( vertShaderCode );
-		VkShaderModule fragShaderModule = createShaderModule( fragShaderCode );
+		uint32_t memoryType = findMemoryType( requirements.memoryTypeBits, properties );
 
-		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;//告诉vulkan该shader插入管线的哪个阶段
-		vertShaderStageInfo.module = vertShaderModule;
-		vertShaderStageInfo.pName = "main";
+		VkDeviceSize offset = 0;
+		for (auto& block : frameBlocks[frameSlot])
+		{
+			if (block->memoryType == memoryType && block->linear.allocate( requirements.size, requirements.alignment, offset ))
+			{
+				return makeAllocation( block.get(), offset, requirements.size, true );
+			}
+		}
 
-		VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fragShaderStageInfo.module = fragShaderModule;
-		fragShaderStageInfo.pName = "main";
+		GpuMemoryBlock* block = createBlock( memoryType, std::max( FRAME_BLOCK_SIZE, requirements.size ), GpuResourceKind::Buffer, frameBlocks[frameSlot] );
+		block->linear.allocate( requirements.size, requirements.alignment, offset );
+		return makeAllocation( block, offset, requirements.size, true );
+	}
 
-		VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-		//管线固定功能：
-		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};//顶点输入（在vs硬编码了）
-		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 0;
-		vertexInputInfo.vertexAttributeDescriptionCount = 0;
+	void free( GpuAllocation& allocation )
+	{
+		if (allocation.block == nullptr || allocation.frameLifetime)
+		{
+			allocation = {};
+			return;
+		}
 
-		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};//输入汇编
-		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;//图元拓扑
-		inputAssembly.primitiveRestartEnable = VK_FALSE;
+		std::lock_guard<std::mutex> lock( mutex );
 
-		VkPipelineViewportStateCreateInfo viewportState{};//视口和裁剪矩形（动态状态）
-		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportState.viewportCount = 1;
-		viewportState.scissorCount = 1;
+		GpuMemoryBlock* block = allocation.block;
+		block->freeList.free( allocation.offset, allocation.size );
+		allocationCount--;
 
-		VkPipelineRasterizationStateCreateInfo rasterizer{};//光栅化器
-		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizer.depthClampEnable = VK_FALSE;
-		rasterizer.rasterizerDiscardEnable = VK_FALSE;
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;//确定如何为几何图形生成片元
-		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-		rasterizer.depthBiasEnable = VK_FALSE;
+		if (block->dedicated)
+		{
+			freeBlockMemory( *block );
+			deviceMemoryCount--;
+			blocks.erase( std::find_if( blocks.begin(), blocks.end(), [block]( const auto& b ) { return b.get() == block; } ) );
+		}
 
-		VkPipelineMultisampleStateCreateInfo multisampling{};
-		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampling.sampleShadingEnable = VK_FALSE;
-		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		//每个帧缓冲区的混合配置
-		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;//确定传递的通道
-		colorBlendAttachment.blendEnable = VK_FALSE;
-		//全局混合配置
-		VkPipelineColorBlendStateCreateInfo colorBlending{};
-		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlending.logicOpEnable = VK_FALSE;
-		colorBlending.logicOp = VK_LOGIC_OP_COPY;
-		colorBlending.attachmentCount = 1;
-		colorBlending.pAttachments = &colorBlendAttachment;
-		colorBlending.blendConstants[0] = 0.0f;
-		colorBlending.blendConstants[1] = 0.0f;
-		colorBlending.blendConstants[2] = 0.0f;
-		colorBlending.blendConstants[3] = 0.0f;
+		allocation = {};
+	}
 
-		std::vector<VkDynamicState> dynamicStates = {
-			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_SCISSOR
+	//frameSlot的栅栏发出信号后调用，该帧的线性分配全部失效
+	void beginFrame( uint32_t frameSlot )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+
+		for (auto& block : frameBlocks[frameSlot])
+		{
+			block->linear.reset();
+		}
+	}
+
+	GpuAllocatorStats getStats()
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+
+		GpuAllocatorStats stats;
+		VkDeviceSize totalFree = 0;
+		VkDeviceSize largestFree = 0;
+		for (auto& block : blocks)
+		{
+			stats.bytesReserved += block->freeList.getCapacity();
+			stats.bytesUsed += block->freeList.getUsed();
+			totalFree += block->freeList.getCapacity() - block->freeList.getUsed();
+			largestFree = std::max( largestFree, block->freeList.largestFreeRange() );
+		}
+		for (auto& slot : frameBlocks)
+		{
+			for (auto& block : slot)
+			{
+				stats.bytesReserved += block->linear.getCapacity();
+				stats.bytesUsed += block->linear.getUsed();
+			}
+		}
+		stats.blockCount = deviceMemoryCount;
+		stats.allocationCount = allocationCount;
+		stats.fragmentation = totalFree > 0 ? 1.0 - static_cast<double>(largestFree) / totalFree : 0.0;
+		return stats;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memProperties{};
+	VkDeviceSize bufferImageGranularity = 1;
+	uint32_t maxAllocationCount = 0;
+	uint32_t deviceMemoryCount = 0;
+	uint32_t allocationCount = 0;
+	std::vector<std::unique_ptr<GpuMemoryBlock>> blocks;
+	std::vector<std::vector<std::unique_ptr<GpuMemoryBlock>>> frameBlocks;//[frameSlot]
+	std::mutex mutex;//资源可能在工作线程中创建
+
+	//小堆（集成显卡的host visible堆等）按堆大小的1/8划分，避免一块就占满
+	VkDeviceSize preferredBlockSize( uint32_t memoryType ) const
+	{
+		VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[memoryType].heapIndex].size;
+		return heapSize <= 1024ull * 1024 * 1024 ? std::min( DEFAULT_BLOCK_SIZE, heapSize / 8 ) : DEFAULT_BLOCK_SIZE;
+	}
+
+	GpuMemoryBlock* createBlock( uint32_t memoryType, VkDeviceSize size, GpuResourceKind kind, std::vector<std::unique_ptr<GpuMemoryBlock>>& owner )
+	{
+		if (deviceMemoryCount >= maxAllocationCount)
+		{
+			throw std::runtime_error( "exceeded maxMemoryAllocationCount!" );
+		}
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		auto block = std::make_unique<GpuMemoryBlock>();
+		if (device != VK_NULL_HANDLE && vkAllocateMemory( device, &allocInfo, nullptr, &block->memory ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to allocate device memory block!" );
+		}
+		deviceMemoryCount++;
+
+		block->memoryType = memoryType;
+		block->kind = kind;
+		block->freeList.init( size );
+		block->linear.init( size );
+
+		if (device != VK_NULL_HANDLE && (memProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+		{
+			void* mapped;
+			if (vkMapMemory( device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped ) != VK_SUCCESS)
+			{
+				vkFreeMemory( device, block->memory, nullptr );
+				deviceMemoryCount--;
+				throw std::runtime_error( "failed to map device memory block!" );
+			}
+			block->mapped = static_cast<char*>(mapped);
+		}
+
+		owner.push_back( std::move( block ) );
+		return owner.back().get();
+	}
+
+	void freeBlockMemory( GpuMemoryBlock& block )
+	{
+		if (device != VK_NULL_HANDLE)
+		{
+			vkFreeMemory( device, block.memory, nullptr );
+		}
+	}
+
+	GpuAllocation makeAllocation( GpuMemoryBlock* block, VkDeviceSize offset, VkDeviceSize size, bool frameLifetime )
+	{
+		GpuAllocation allocation;
+		allocation.memory = block->memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.mapped = block->mapped != nullptr ? block->mapped + offset : nullptr;
+		allocation.block = block;
+		allocation.frameLifetime = frameLifetime;
+		if (!frameLifetime)
+		{
+			allocationCount++;
+		}
+		return allocation;
+	}
+};
+
+//自测的一项检查：打印结果，失败时计数
+void selfTestCheck( uint32_t& failures, bool condition, const char* name )
+{
+	std::cout << (condition ? "PASS " : "FAIL ") << name << std::endl;
+	failures += condition ? 0 : 1;
+}
+
+//--self-test：分配器的CPU侧检查，不需要窗口和GPU。返回失败的检查数
+uint32_t runAllocatorSelfTest()
+{
+	uint32_t failures = 0;
+	auto check = [&failures]( bool condition, const char* name ) { selfTestCheck( failures, condition, name ); };
+	const VkDeviceSize MiB = 1024 * 1024;
+
+	//free list：对齐产生的前部空隙仍然可以分配
+	{
+		FreeListRange range;
+		range.init( 1024 );
+		VkDeviceSize a, b, c;
+		check( range.allocate( 10, 1, a ) && a == 0, "free list allocates from offset 0" );
+		check( range.allocate( 100, 256, b ) && b == 256, "free list honors alignment" );
+		check( range.allocate( 200, 1, c ) && c == 10, "alignment padding stays allocatable" );
+		check( range.getUsed() == 310, "free list tracks used bytes" );
+	}
+
+	//释放时与前后相邻的空闲区合并
+	{
+		FreeListRange range;
+		range.init( 300 );
+		VkDeviceSize a, b, c;
+		range.allocate( 100, 1, a );
+		range.allocate( 100, 1, b );
+		range.allocate( 100, 1, c );
+		range.free( a, 100 );
+		range.free( c, 100 );
+		check( range.largestFreeRange() == 100, "non-adjacent free ranges stay separate" );
+		range.free( b, 100 );
+		check( range.largestFreeRange() == 300 && range.isEmpty(), "freeing the middle range coalesces both neighbours" );
+		VkDeviceSize whole;
+		check( range.allocate( 300, 1, whole ) && whole == 0, "coalesced range satisfies a full-size allocation" );
+	}
+
+	//耗尽
+	{
+		FreeListRange range;
+		range.init( 256 );
+		VkDeviceSize a, b;
+		check( range.allocate( 200, 1, a ), "free list allocation within capacity" );
+		check( !range.allocate( 100, 1, b ), "free list reports exhaustion" );
+		check( !range.allocate( 56, 16, b ), "alignment counts toward exhaustion" );
+	}
+
+	//线性分配器整体reset
+	{
+		LinearRange range;
+		range.init( 256 );
+		VkDeviceSize a, b;
+		range.allocate( 100, 1, a );
+		check( range.allocate( 100, 64, b ) && b == 128, "linear range aligns its head" );
+		check( !range.allocate( 100, 1, b ), "linear range reports exhaustion" );
+		range.reset();
+		check( range.getUsed() == 0 && range.allocate( 200, 1, a ) && a == 0, "linear range reset reuses the whole range" );
+	}
+
+	//GpuAllocator簿记模式：一个8 GiB的device local堆，块大小为DEFAULT_BLOCK_SIZE
+	VkPhysicalDeviceMemoryProperties memProperties{};
+	memProperties.memoryTypeCount = 1;
+	memProperties.memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	memProperties.memoryTypes[0].heapIndex = 0;
+	memProperties.memoryHeapCount = 1;
+	memProperties.memoryHeaps[0].size = 8192 * MiB;
+	auto requirements = []( VkDeviceSize size )
+		{
+			VkMemoryRequirements req{};
+			req.size = size;
+			req.alignment = 256;
+			req.memoryTypeBits = 1;
+			return req;
 		};
-		VkPipelineDynamicStateCreateInfo dynamicState{};
-		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-		dynamicState.pDynamicStates = dynamicStates.data();
 
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 0;
-		pipelineLayoutInfo.pushConstantRangeCount = 0;
+	//块用完时增长，超过maxMemoryAllocationCount时报错
+	{
+		GpuAllocator allocator;
+		allocator.init( VK_NULL_HANDLE, memProperties, 1, 2, 2 );
+		GpuAllocation a = allocator.allocate( requirements( 24 * MiB ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Buffer );
+		GpuAllocation b = allocator.allocate( requirements( 24 * MiB ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Buffer );
+		check( allocator.getStats().blockCount == 1 && a.block == b.block, "allocations share a block while it has room" );
+		GpuAllocation c = allocator.allocate( requirements( 24 * MiB ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Buffer );
+		check( allocator.getStats().blockCount == 2 && c.block != a.block, "a full block grows the allocator by one block" );
+		bool threw = false;
+		try
+		{
+			allocator.allocate( requirements( 48 * MiB ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Buffer );
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+		check( threw, "growth stops at maxMemoryAllocationCount" );
+		allocator.free( a );
+		allocator.free( b );
+		allocator.free( c );
+		check( allocator.getStats().allocationCount == 0, "freed allocations are no longer counted" );
+		allocator.destroy();
+	}
 
-		if (vkCreatePipelineLayout( device, &pipelineLayoutInfo, nullptr, &pipelineLayout ) != VK_SUCCESS)
+	//碎片率 = 1 - 最大空闲区/总空闲
+	{
+		GpuAllocator allocator;
+		allocator.init( VK_NULL_HANDLE, memProperties, 1, 16, 2 );
+		GpuAllocation a = allocator.allocate( requirements( 8 * MiB ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Buffer );
+		GpuAllocation b = allocator.allocate( requirements( 8 * MiB ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Buffer );
+		GpuAllocation c = allocator.allocate( requirements( 8 * MiB ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Buffer );
+		check( allocator.getStats().fragmentation == 0.0, "contiguous free space has no fragmentation" );
+		allocator.free( b );
+		GpuAllocatorStats stats = allocator.getStats();
+		check( std::abs( stats.fragmentation - (1.0 - 40.0 / 48.0) ) < 1e-9, "a hole between allocations is reported as fragmentation" );
+		check( stats.bytesUsed == 16 * MiB && stats.bytesReserved == GpuAllocator::DEFAULT_BLOCK_SIZE, "used and reserved bytes" );
+		allocator.free( a );
+		allocator.free( c );
+		check( allocator.getStats().fragmentation == 0.0, "freeing the neighbours removes the fragmentation" );
+		allocator.destroy();
+	}
+
+	//每帧分配在该帧的beginFrame时整体回收
+	{
+		GpuAllocator allocator;
+		allocator.init( VK_NULL_HANDLE, memProperties, 1, 16, 2 );
+		GpuAllocation a = allocator.allocateFrame( requirements( 1 * MiB ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 );
+		allocator.allocateFrame( requirements( 1 * MiB ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1 );
+		check( allocator.getStats().bytesUsed == 2 * MiB, "frame allocations are counted per slot" );
+		allocator.beginFrame( 0 );
+		check( allocator.getStats().bytesUsed == 1 * MiB, "beginFrame resets only its own slot" );
+		GpuAllocation b = allocator.allocateFrame( requirements( 1 * MiB ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 );
+		check( b.block == a.block && b.offset == 0 && allocator.getStats().blockCount == 2, "a reset slot reuses its block from the start" );
+		allocator.destroy();
+	}
+
+	//bufferImageGranularity为1时缓冲区和OPTIMAL图像共用块并紧挨着放置
+	{
+		GpuAllocator allocator;
+		allocator.init( VK_NULL_HANDLE, memProperties, 1, 16, 2 );
+		GpuAllocation buffer = allocator.allocate( requirements( 1000 ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Buffer );
+		GpuAllocation image = allocator.allocate( requirements( 1000 ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Image );
+		check( image.block == buffer.block && image.offset == 1024 && allocator.getStats().blockCount == 1,
+			"without a granularity limit a buffer and an image share a block" );
+		allocator.destroy();
+	}
+
+	//bufferImageGranularity大于1时两者分到不同的块，同一块内的资源都是同一类，不会在一个粒度页内混放
+	{
+		GpuAllocator allocator;
+		allocator.init( VK_NULL_HANDLE, memProperties, 4096, 16, 2 );
+		GpuAllocation buffer = allocator.allocate( requirements( 1000 ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Buffer );
+		GpuAllocation image = allocator.allocate( requirements( 1000 ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Image );
+		GpuAllocation buffer2 = allocator.allocate( requirements( 1000 ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Buffer );
+		GpuAllocation image2 = allocator.allocate( requirements( 1000 ), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Image );
+		check( image.block != buffer.block && allocator.getStats().blockCount == 2,
+			"with a granularity limit a buffer and an image get separate blocks" );
+		check( buffer2.block == buffer.block && image2.block == image.block && buffer2.offset == 1024 && image2.offset == 1024,
+			"same-kind allocations keep packing tightly under a granularity limit" );
+		allocator.destroy();
+	}
+
+	std::cout << (failures == 0 ? "allocator self-test passed" : "allocator self-test FAILED") << std::endl;
+	return failures;
+}
+
+//持久映射的上传环形缓冲区，每个飞行中的帧占一段区域。帧开始时（该帧的栅栏已发出信号）
+//重置对应区域，之后按对齐要求线性分配，每帧既不需要map/unmap也不需要新的内存分配
+class UploadRing
+{
+public:
+	void init( VkBuffer buffer, void* mapped, VkDeviceSize regionSize, uint32_t frameCount )
+	{
+		this->buffer = buffer;
+		this->mapped = static_cast<char*>(mapped);
+		this->regionSize = regionSize;
+		this->frameCount = frameCount;
+		regionBase = 0;
+		head = 0;
+	}
+
+	void beginFrame( uint32_t frameSlot )
+	{
+		if (frameSlot >= frameCount)
+		{
+			throw std::runtime_error( "upload ring frame slot out of range!" );//区域会越过缓冲区末尾
+		}
+		regionBase = frameSlot * regionSize;
+		head = 0;
+	}
+
+	//返回在整个缓冲区中的偏移，data指向对应的映射地址
+	VkDeviceSize allocate( VkDeviceSize size, VkDeviceSize alignment, void** data )
+	{
+		VkDeviceSize offset = alignUp( regionBase + head, alignment );
+		if (offset + size > regionBase + regionSize)
+		{
+			throw std::runtime_error( "upload ring region exhausted!" );
+		}
+
+		head = offset + size - regionBase;
+		highWater = std::max( highWater, head );
+		*data = mapped + offset;
+		return offset;
+	}
+
+	VkBuffer getBuffer() const { return buffer; }
+	VkDeviceSize getRegionSize() const { return regionSize; }
+	VkDeviceSize getHighWater() const { return highWater; }//单帧用量的峰值
+
+private:
+	VkBuffer buffer = VK_NULL_HANDLE;
+	char* mapped = nullptr;
+	VkDeviceSize regionSize = 0;
+	uint32_t frameCount = 0;
+	VkDeviceSize regionBase = 0;
+	VkDeviceSize head = 0;
+	VkDeviceSize highWater = 0;
+};
+
+//纹理暂存环形缓冲区：加载线程把像素写进来，复制完成后释放，空间按分配顺序回收（释放可以乱序）。
+//空间不够时allocate阻塞到有空间为止，只在加载线程上分配，不会阻塞渲染循环
+class StagingRing
+{
+public:
+	struct Allocation
+	{
+		VkDeviceSize offset = 0;
+		uint64_t id = 0;
+	};
+
+	void init( VkBuffer buffer, void* mapped, VkDeviceSize capacity )
+	{
+		this->buffer = buffer;
+		this->mapped = static_cast<char*>(mapped);
+		this->capacity = capacity;
+		head = 0;
+		used = 0;
+		closed = false;
+	}
+
+	//shutdown之后返回false
+	bool allocate( VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation )
+	{
+		if (size > capacity)
+		{
+			throw std::runtime_error( "staging ring too small for upload!" );
+		}
+
+		std::unique_lock<std::mutex> lock( mutex );
+		while (true)
+		{
+			if (closed)
+			{
+				return false;
+			}
+			//末尾放不下时从0开始，跳过的部分算在这次分配里
+			VkDeviceSize offset = alignUp( head, alignment );
+			if (offset + size > capacity)
+			{
+				offset = 0;
+			}
+			VkDeviceSize length = (offset >= head ? offset - head : capacity - head + offset) + size;
+			if (used + length <= capacity)
+			{
+				allocation.offset = offset;
+				allocation.id = nextId++;
+				blocks.push_back( { length, false } );
+				head = offset + size == capacity ? 0 : offset + size;
+				used += length;
+				return true;
+			}
+			freed.wait( lock );
+		}
+	}
+
+	void free( const Allocation& allocation )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		blocks[static_cast<size_t>(allocation.id - (nextId - blocks.size()))].released = true;
+		while (!blocks.empty() && blocks.front().released)
+		{
+			used -= blocks.front().length;
+			blocks.pop_front();
+		}
+		freed.notify_all();
+	}
+
+	//唤醒所有等待空间的加载线程
+	void shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			closed = true;
+		}
+		freed.notify_all();
+	}
+
+	VkBuffer getBuffer() const { return buffer; }
+	char* getMapped( VkDeviceSize offset ) const { return mapped + offset; }
+
+private:
+	struct Block
+	{
+		VkDeviceSize length;
+		bool released;
+	};
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	char* mapped = nullptr;
+	VkDeviceSize capacity = 0;
+	VkDeviceSize head = 0;
+	VkDeviceSize used = 0;
+	uint64_t nextId = 0;
+	std::deque<Block> blocks;//按分配顺序
+	std::mutex mutex;
+	std::condition_variable freed;
+	bool closed = false;
+};
+
+struct DescriptorAllocatorStats
+{
+	uint32_t poolCount = 0;
+	uint64_t setsAllocated = 0;
+	uint64_t poolResets = 0;
+};
+
+//按帧分配描述符集：每个飞行中的帧有自己的一组描述符池，帧开始时（该帧的栅栏已发出信号）整体重置，
+//描述符集从不单独释放。池用完时为该帧再创建一个，之后一直复用。只在主线程上使用
+class DescriptorAllocator
+{
+public:
+	//poolSizes和setsPerPool描述单个池的容量
+	void init( VkDevice device, uint32_t frameCount, std::vector<VkDescriptorPoolSize> poolSizes, uint32_t setsPerPool )
+	{
+		this->device = device;
+		this->poolSizes = std::move( poolSizes );
+		this->setsPerPool = setsPerPool;
+		frames.assign( frameCount, FramePools{} );
+		frame = 0;
+	}
+
+	void beginFrame( uint32_t frameSlot )
+	{
+		frame = frameSlot;
+		FramePools& pools = frames[frame];
+		for (size_t i = 0; i < std::min( pools.current + 1, pools.pools.size() ); i++)
+		{
+			vkResetDescriptorPool( device, pools.pools[i], 0 );
+			stats.poolResets++;
+		}
+		pools.current = 0;
+	}
+
+	VkDescriptorSet allocate( VkDescriptorSetLayout layout )
+	{
+		FramePools& pools = frames[frame];
+		while (true)
+		{
+			bool created = false;
+			if (pools.current == pools.pools.size())
+			{
+				pools.pools.push_back( createPool() );
+				created = true;
+			}
+
+			VkDescriptorSetAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocInfo.descriptorPool = pools.pools[pools.current];
+			allocInfo.descriptorSetCount = 1;
+			allocInfo.pSetLayouts = &layout;
+
+			VkDescriptorSet set;
+			VkResult result = vkAllocateDescriptorSets( device, &allocInfo, &set );
+			if (result == VK_SUCCESS)
+			{
+				stats.setsAllocated++;
+				return set;
+			}
+			//新创建的池也放不下说明单个集合超过了池的容量
+			if ((result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) || created)
+			{
+				throw std::runtime_error( "failed to allocate descriptor set!" );
+			}
+			pools.current++;
+		}
+	}
+
+	//设备空闲后调用
+	void destroy()
+	{
+		for (FramePools& pools : frames)
+		{
+			for (VkDescriptorPool pool : pools.pools)
+			{
+				vkDestroyDescriptorPool( device, pool, nullptr );
+			}
+		}
+		frames.clear();
+	}
+
+	DescriptorAllocatorStats getStats() const { return stats; }
+
+private:
+	struct FramePools
+	{
+		std::vector<VkDescriptorPool> pools;
+		size_t current = 0;//本帧正在分配的池，之前的都已经用满
+	};
+
+	VkDescriptorPool createPool()
+	{
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = setsPerPool;
+
+		VkDescriptorPool pool;
+		if (vkCreateDescriptorPool( device, &poolInfo, nullptr, &pool ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create descriptor pool!" );
+		}
+		stats.poolCount++;
+		return pool;
+	}
+
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	uint32_t setsPerPool = 0;
+	std::vector<FramePools> frames;
+	uint32_t frame = 0;
+	DescriptorAllocatorStats stats;
+};
+
+//延迟销毁队列：资源被替换后，连同最后一次使用它的帧号（或时间线信号量的值）一起放入队列，
+//等这个值对应的GPU工作确认完成后再真正销毁，替换资源时不需要vkDeviceWaitIdle
+class DeletionQueue
+{
+public:
+	void push( uint64_t lastUsed, std::function<void()> deleter )
+	{
+		entries.push_back( { lastUsed, std::move( deleter ) } );
+	}
+
+	//销毁lastUsed <= completed的资源
+	void flush( uint64_t completed )
+	{
+		auto entry = entries.begin();
+		while (entry != entries.end())
+		{
+			if (entry->lastUsed <= completed)
+			{
+				entry->deleter();
+				entry = entries.erase( entry );
+			}
+			else
+			{
+				++entry;
+			}
+		}
+	}
+
+	//设备空闲后调用
+	void flushAll()
+	{
+		for (Entry& entry : entries)
+		{
+			entry.deleter();
+		}
+		entries.clear();
+	}
+
+	size_t size() const { return entries.size(); }
+
+private:
+	struct Entry
+	{
+		uint64_t lastUsed;
+		std::function<void()> deleter;
+	};
+	std::vector<Entry> entries;
+};
+
+//固定数量的工作线程。dispatch把同一个任务交给每个线程（参数为线程序号）执行，并等待全部完成；
+//post把任务放进队列后立即返回，由空闲的线程按提交顺序开始执行。stop丢弃还没开始的任务，等正在执行的完成
+class WorkerPool
+{
+public:
+	~WorkerPool()
+	{
+		stop();
+	}
+
+	void start( uint32_t threadCount )
+	{
+		stopping = false;
+		for (uint32_t i = 0; i < threadCount; i++)
+		{
+			threads.emplace_back( &WorkerPool::workerMain, this, i );
+		}
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			stopping = true;
+			tasks.clear();
+		}
+		wake.notify_all();
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		threads.clear();
+	}
+
+	//task不能抛出异常，需要报告的错误由任务自己处理
+	void post( std::function<void()> task )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			tasks.push_back( std::move( task ) );
+		}
+		wake.notify_one();
+	}
+
+	//任一线程抛出的异常会在这里重新抛出
+	void dispatch( const std::function<void( uint32_t )>& job )
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		task = &job;
+		pending = static_cast<uint32_t>(threads.size());
+		error = nullptr;
+		generation++;
+		wake.notify_all();
+		done.wait( lock, [this]() { return pending == 0; } );
+		task = nullptr;
+
+		if (error)
+		{
+			std::rethrow_exception( error );
+		}
+	}
+
+	uint32_t size() const { return static_cast<uint32_t>(threads.size()); }
+
+private:
+	void workerMain( uint32_t index )
+	{
+		uint64_t seenGeneration = 0;
+		while (true)
+		{
+			const std::function<void( uint32_t )>* job;
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+				wake.wait( lock, [&]() { return stopping || generation != seenGeneration || !tasks.empty(); } );
+				if (stopping)
+				{
+					return;
+				}
+				if (generation == seenGeneration)
+				{
+					std::function<void()> posted = std::move( tasks.front() );
+					tasks.pop_front();
+					lock.unlock();
+					posted();
+					continue;
+				}
+				seenGeneration = generation;
+				job = task;
+			}
+
+			std::exception_ptr jobError;
+			try
+			{
+				(*job)(index);
+			}
+			catch (...)
+			{
+				jobError = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock( mutex );
+			if (jobError && !error)
+			{
+				error = jobError;
+			}
+			if (--pending == 0)
+			{
+				done.notify_one();
+			}
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void( uint32_t )>* task = nullptr;
+	uint64_t generation = 0;
+	uint32_t pending = 0;
+	bool stopping = false;
+	std::exception_ptr error;
+};
+
+//图形管线的完整描述。哈希和相等比较覆盖全部字段，描述相同的请求共享同一个VkPipeline
+struct GraphicsPipelineDesc
+{
+	std::string vertexShader;//.spv路径
+	std::string fragmentShader;
+	bool instanced = false;//是否有每实例顶点绑定
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+	BlendMode blend = BlendMode::Opaque;
+	VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+	VkRenderPass renderPass = VK_NULL_HANDLE;//动态渲染时为空
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	std::vector<uint32_t> specialization;//特化常量，constant_id为i的常量取第i个值，两个着色器阶段共用
+
+	bool operator==( const GraphicsPipelineDesc& other ) const
+	{
+		return vertexShader == other.vertexShader && fragmentShader == other.fragmentShader && instanced == other.instanced &&
+			topology == other.topology && polygonMode == other.polygonMode && cullMode == other.cullMode && frontFace == other.frontFace &&
+			blend == other.blend && colorFormat == other.colorFormat && renderPass == other.renderPass && layout == other.layout &&
+			specialization == other.specialization;
+	}
+};
+
+struct GraphicsPipelineDescHash
+{
+	size_t operator()( const GraphicsPipelineDesc& desc ) const
+	{
+		//FNV-1a，逐字段混入
+		uint64_t hash = 14695981039346656037ull;
+		auto mix = [&hash]( const void* data, size_t size )
+			{
+				const unsigned char* bytes = static_cast<const unsigned char*>(data);
+				for (size_t i = 0; i < size; i++)
+				{
+					hash = (hash ^ bytes[i]) * 1099511628211ull;
+				}
+			};
+		auto mixValue = [&mix]( const auto& value ) { mix( &value, sizeof( value ) ); };
+
+		mix( desc.vertexShader.data(), desc.vertexShader.size() );
+		mixValue( '\0' );
+		mix( desc.fragmentShader.data(), desc.fragmentShader.size() );
+		mixValue( desc.instanced );
+		mixValue( desc.topology );
+		mixValue( desc.polygonMode );
+		mixValue( desc.cullMode );
+		mixValue( desc.frontFace );
+		mixValue( desc.blend );
+		mixValue( desc.colorFormat );
+		mixValue( desc.renderPass );
+		mixValue( desc.layout );
+		mix( desc.specialization.data(), desc.specialization.size() * sizeof( uint32_t ) );
+		return static_cast<size_t>(hash);
+	}
+};
+
+struct PipelineManagerStats
+{
+	uint32_t variantCount = 0;//已经编译好的管线数
+	uint64_t requestCount = 0;
+	uint64_t cacheHits = 0;//请求时管线已经就绪
+	uint32_t backgroundCompiles = 0;
+	double backgroundCompileMs = 0.0;
+	uint32_t reloads = 0;//着色器热重载后替换掉的管线数
+};
+
+//管线管理器：按描述缓存VkPipeline。get在调用线程上编译缺失的管线（初始化时用），
+//request把缺失的管线交给后台线程编译并立即返回备用管线，渲染循环不会因为新的变体卡顿
+class PipelineManager
+{
+public:
+	typedef std::function<VkPipeline( const GraphicsPipelineDesc& )> BuildFunction;
+
+	~PipelineManager()
+	{
+		stop();
+	}
+
+	void start( BuildFunction build, uint32_t threadCount )
+	{
+		this->build = std::move( build );
+		stopping = false;
+		workers.start( threadCount );
+	}
+
+	//还在排队的编译被丢弃，正在编译的会等它完成。之后get在调用线程上编译被丢弃的条目
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			stopping = true;
+			queue.clear();
+		}
+		workers.stop();
+	}
+
+	VkPipeline get( const GraphicsPipelineDesc& desc )
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		stats.requestCount++;
+		auto it = entries.find( desc );
+		if (it == entries.end())
+		{
+			return compileOnCaller( desc, entries.emplace( desc, Entry{} ).first->second, lock );
+		}
+
+		//还在排队的不等后台线程，直接在这里编译；stop之后没有后台线程，排队的编译已被丢弃
+		Entry& entry = it->second;//元素的引用在rehash后仍然有效
+		if (!entry.ready)
+		{
+			size_t queued = queue.size();
+			queue.erase( std::remove( queue.begin(), queue.end(), desc ), queue.end() );
+			if (stopping || queue.size() != queued)
+			{
+				return compileOnCaller( desc, entry, lock );
+			}
+		}
+
+		//正在后台编译的等它完成，不重复编译
+		compiled.wait( lock, [&entry]() { return entry.ready; } );
+		if (entry.pipeline == VK_NULL_HANDLE)
+		{
+			throw std::runtime_error( "failed to create graphics pipeline!" );
+		}
+		stats.cacheHits++;
+		return entry.pipeline;
+	}
+
+	//只查找已经就绪的管线，不编译也不计入请求统计，没有时返回VK_NULL_HANDLE
+	VkPipeline find( const GraphicsPipelineDesc& desc )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		auto it = entries.find( desc );
+		return it != entries.end() && it->second.ready ? it->second.pipeline : VK_NULL_HANDLE;
+	}
+
+	//管线还没有就绪时返回fallback
+	VkPipeline request( const GraphicsPipelineDesc& desc, VkPipeline fallback )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		stats.requestCount++;
+		auto it = entries.find( desc );
+		if (it == entries.end())
+		{
+			entries.emplace( desc, Entry{} );
+			queue.push_back( desc );
+			workers.post( [this]() { compileNext(); } );
+			return fallback;
+		}
+		if (!it->second.ready || it->second.pipeline == VK_NULL_HANDLE)
+		{
+			return fallback;
+		}
+		stats.cacheHits++;
+		return it->second.pipeline;
+	}
+
+	//用到该着色器的管线全部在后台重新编译，编译完成前继续使用旧管线
+	void reload( const std::string& shaderPath )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		for (auto& entry : entries)
+		{
+			if (entry.first.vertexShader == shaderPath || entry.first.fragmentShader == shaderPath)
+			{
+				queue.push_back( entry.first );
+				workers.post( [this]() { compileNext(); } );
+			}
+		}
+	}
+
+	//取走被重新编译的管线替换下来的旧管线，可能仍被飞行中的帧使用，由调用者延迟销毁
+	std::vector<VkPipeline> takeReplaced()
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		std::vector<VkPipeline> result;
+		result.swap( replaced );
+		return result;
+	}
+
+	//调用前先stop，设备必须已经空闲
+	void destroy( VkDevice device )
+	{
+		for (auto& entry : entries)
+		{
+			vkDestroyPipeline( device, entry.second.pipeline, nullptr );
+		}
+		entries.clear();
+		for (VkPipeline pipeline : replaced)
+		{
+			vkDestroyPipeline( device, pipeline, nullptr );
+		}
+		replaced.clear();
+	}
+
+	PipelineManagerStats getStats()
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		return stats;
+	}
+
+private:
+	struct Entry
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;//编译失败时保持为空，之后的请求一直使用备用管线
+		bool ready = false;
+	};
+
+	//调用时持有lock，编译期间释放，返回时重新持有
+	VkPipeline compileOnCaller( const GraphicsPipelineDesc& desc, Entry& entry, std::unique_lock<std::mutex>& lock )
+	{
+		lock.unlock();
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		try
+		{
+			pipeline = build( desc );
+		}
+		catch (...)
+		{
+			lock.lock();
+			entry.ready = true;
+			compiled.notify_all();
+			throw;
+		}
+		lock.lock();
+		entry.pipeline = pipeline;
+		entry.ready = true;
+		stats.variantCount++;
+		compiled.notify_all();
+		return pipeline;
+	}
+
+	//每次入队对应一个任务；get可能已经取走了条目，这时队列比任务少，多出的任务直接返回
+	void compileNext()
+	{
+		GraphicsPipelineDesc desc;
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			if (queue.empty())
+			{
+				return;
+			}
+			desc = std::move( queue.front() );
+			queue.pop_front();
+		}
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		auto compileStart = std::chrono::steady_clock::now();
+		try
+		{
+			pipeline = build( desc );
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "background pipeline compile failed: " << e.what() << std::endl;
+		}
+		double compileMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - compileStart ).count();
+
+		std::lock_guard<std::mutex> lock( mutex );
+		Entry& entry = entries[desc];
+		stats.backgroundCompiles++;
+		stats.backgroundCompileMs += compileMs;
+		if (pipeline != VK_NULL_HANDLE)
+		{
+			//重新编译失败时保留旧管线
+			if (entry.pipeline != VK_NULL_HANDLE)
+			{
+				replaced.push_back( entry.pipeline );
+				stats.reloads++;
+			}
+			else
+			{
+				stats.variantCount++;
+			}
+			entry.pipeline = pipeline;
+		}
+		entry.ready = true;
+		compiled.notify_all();
+	}
+
+	BuildFunction build;
+	std::unordered_map<GraphicsPipelineDesc, Entry, GraphicsPipelineDescHash> entries;
+	std::deque<GraphicsPipelineDesc> queue;
+	std::vector<VkPipeline> replaced;
+	WorkerPool workers;
+	std::mutex mutex;
+	std::condition_variable compiled;
+	bool stopping = false;
+	PipelineManagerStats stats;
+};
+
+//一个需要热重载的着色器源文件和它编译出的SPIR-V文件
+struct ShaderSource
+{
+	std::string source;
+	std::string output;
+};
+
+//与compile.bat保持一致，计算着色器不参与热重载
+const ShaderSource HOT_RELOAD_SHADERS[] = {
+	{ "shaders/triangle.vert", "shaders/vert.spv" },
+	{ "shaders/triangle.frag", "shaders/frag.spv" },
+	{ "shaders/instanced.vert", "shaders/instanced_vert.spv" },
+	{ "shaders/bindless.vert", "shaders/bindless_vert.spv" },
+	{ "shaders/bindless.frag", "shaders/bindless_frag.spv" },
+};
+
+struct ShaderWatcherStats
+{
+	uint32_t compiles = 0;
+	uint32_t failures = 0;
+	double compileMs = 0.0;
+};
+
+//着色器监视器：后台线程监视源文件（Windows用目录变更通知唤醒，其他平台轮询修改时间），
+//改动后重新编译成SPIR-V并写回输出文件，主线程在帧边界通过takeCompiled取走编译好的文件
+class ShaderWatcher
+{
+public:
+	~ShaderWatcher()
+	{
+		stop();
+	}
+
+	void start( std::vector<ShaderSource> sources )
+	{
+		this->sources = std::move( sources );
+		for (const ShaderSource& shader : this->sources)
+		{
+			std::error_code error;
+			writeTimes.push_back( std::filesystem::last_write_time( shader.source, error ) );
+		}
+#ifdef _WIN32
+		//编辑器常常写临时文件再重命名，所以监视目录而不是文件本身
+		std::set<std::string> directories;
+		for (const ShaderSource& shader : this->sources)
+		{
+			directories.insert( std::filesystem::path( shader.source ).parent_path().string() );
+		}
+		for (const std::string& directory : directories)
+		{
+			HANDLE handle = FindFirstChangeNotificationA( directory.empty() ? "." : directory.c_str(), FALSE,
+				FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME );
+			if (handle != INVALID_HANDLE_VALUE)
+			{
+				changeNotifications.push_back( handle );
+			}
+		}
+#endif
+		stopping = false;
+		thread = std::thread( &ShaderWatcher::watchMain, this );
+	}
+
+	void stop()
+	{
+		stopping = true;
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+#ifdef _WIN32
+		for (HANDLE handle : changeNotifications)
+		{
+			FindCloseChangeNotification( handle );
+		}
+		changeNotifications.clear();
+#endif
+	}
+
+	//返回上次调用之后重新编译成功的SPIR-V文件路径
+	std::vector<std::string> takeCompiled()
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		std::vector<std::string> result;
+		result.swap( compiled );
+		return result;
+	}
+
+	ShaderWatcherStats getStats()
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		return stats;
+	}
+
+private:
+	void watchMain()
+	{
+		while (!stopping)
+		{
+			std::set<size_t> changed = waitForChanges();
+			if (changed.empty())
+			{
+				continue;
+			}
+			//保存往往分几次写入，稍等片刻再读取源文件
+			std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+			for (size_t index : changed)
+			{
+				auto compileStart = std::chrono::steady_clock::now();
+				bool success = compile( sources[index] );
+				double compileMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - compileStart ).count();
+
+				std::lock_guard<std::mutex> lock( mutex );
+				stats.compileMs += compileMs;
+				if (success)
+				{
+					stats.compiles++;
+					compiled.push_back( sources[index].output );
+					std::cout << "reloaded " << sources[index].source << " (" << compileMs << " ms)" << std::endl;
+				}
+				else
+				{
+					stats.failures++;
+				}
+			}
+		}
+	}
+
+	//最多阻塞约250毫秒，返回有改动的源文件下标
+	std::set<size_t> waitForChanges()
+	{
+		std::set<size_t> changed;
+#ifdef _WIN32
+		//通知只说明目录有改动，改动的是哪个文件仍然比较修改时间（写出.spv也会唤醒一次）
+		if (!changeNotifications.empty())
+		{
+			DWORD count = static_cast<DWORD>(changeNotifications.size());
+			DWORD result = WaitForMultipleObjects( count, changeNotifications.data(), FALSE, 250 );
+			if (result >= WAIT_OBJECT_0 + count)
+			{
+				return changed;//超时，stop在250毫秒内就能让线程退出
+			}
+			FindNextChangeNotification( changeNotifications[result - WAIT_OBJECT_0] );
+		}
+		else
+#endif
+		{
+			std::this_thread::sleep_for( std::chrono::milliseconds( 250 ) );
+		}
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			std::error_code error;
+			auto writeTime = std::filesystem::last_write_time( sources[i].source, error );
+			if (!error && writeTime != writeTimes[i])
+			{
+				writeTimes[i] = writeTime;
+				changed.insert( i );
+			}
+		}
+		return changed;
+	}
+
+	//先写到临时文件再重命名，渲染线程读取SPIR-V时不会读到写了一半的文件
+	bool compile( const ShaderSource& shader )
+	{
+		std::string temporary = shader.output + ".tmp";
+#ifdef USE_SHADERC
+		std::ifstream file( shader.source, std::ios::binary );
+		if (!file.is_open())
+		{
+			std::cerr << "failed to open " << shader.source << std::endl;
+			return false;
+		}
+		std::string text( (std::istreambuf_iterator<char>( file )), std::istreambuf_iterator<char>() );
+		shaderc_shader_kind kind = std::filesystem::path( shader.source ).extension() == ".frag" ? shaderc_glsl_fragment_shader : shaderc_glsl_vertex_shader;
+		shaderc::CompileOptions options;
+		options.SetOptimizationLevel( shaderc_optimization_level_performance );
+		shaderc::SpvCompilationResult result = shaderCompiler.CompileGlslToSpv( text, kind, shader.source.c_str(), options );
+		if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+		{
+			std::cerr << result.GetErrorMessage();
+			return false;
+		}
+		std::ofstream output( temporary, std::ios::binary | std::ios::trunc );
+		output.write( reinterpret_cast<const char*>(result.cbegin()), (result.cend() - result.cbegin()) * sizeof( uint32_t ) );
+		output.close();
+		if (!output)
+		{
+			std::cerr << "failed to write " << temporary << std::endl;
+			return false;
+		}
+#else
+		//没有链接shaderc时调用Vulkan SDK的glslc
+		const char* sdk = std::getenv( "VULKAN_SDK" );
+		std::string compiler = sdk ? (std::filesystem::path( sdk ) / "bin" / "glslc").string() : "glslc";
+		std::string command = "\"" + compiler + "\" \"" + shader.source + "\" -o \"" + temporary + "\"";
+#ifdef _WIN32
+		command = "\"" + command + "\"";//cmd会去掉最外层的一对引号
+#endif
+		if (std::system( command.c_str() ) != 0)
+		{
+			return false;
+		}
+#endif
+		std::error_code error;
+		std::filesystem::rename( temporary, shader.output, error );
+		if (error)
+		{
+			std::cerr << "failed to replace " << shader.output << ": " << error.message() << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	std::vector<ShaderSource> sources;
+	std::vector<std::filesystem::file_time_type> writeTimes;
+	std::vector<std::string> compiled;
+	std::thread thread;
+	std::mutex mutex;
+	std::atomic<bool> stopping = false;
+	ShaderWatcherStats stats;
+#ifdef _WIN32
+	std::vector<HANDLE> changeNotifications;
+#endif
+#ifdef USE_SHADERC
+	shaderc::Compiler shaderCompiler;//只在监视线程上使用
+#endif
+};
+
+//渲染图中资源的一次使用：所在阶段、访问类型和图像布局（缓冲区忽略布局）
+struct RenderGraphAccess
+{
+	VkPipelineStageFlags stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	VkAccessFlags access = 0;
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+struct RenderGraphImageDesc
+{
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent{};
+	VkImageUsageFlags usage = 0;
+	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+struct RenderGraphStats
+{
+	uint32_t passCount = 0;
+	uint32_t culledPassCount = 0;
+	uint32_t barrierCount = 0;//每次执行的vkCmdPipelineBarrier次数
+	uint32_t transientImageCount = 0;
+	VkDeviceSize transientBytes = 0;//别名之后实际分配的内存
+	VkDeviceSize transientBytesUnaliased = 0;//每个临时图像单独分配时需要的内存
+};
+
+//编译后的一个屏障，pass为空表示执行结束时转换到最终状态
+struct RenderGraphBarrier
+{
+	std::string pass;
+	std::string resource;
+	VkPipelineStageFlags srcStage;
+	VkPipelineStageFlags dstStage;
+	VkAccessFlags srcAccess;
+	VkAccessFlags dstAccess;
+	VkImageLayout oldLayout;
+	VkImageLayout newLayout;
+};
+
+const VkAccessFlags RENDER_GRAPH_WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+//渲染图：每个pass声明它读写的资源和使用方式，compile时剔除输出没有被使用的pass，
+//按声明顺序算出pass之间的屏障和布局转换，并让生命周期不重叠的临时图像共享同一块内存。
+//结构在初始化（和交换链重建）时编译一次，每帧只更新导入资源的句柄后执行
+class RenderGraph
+{
+public:
+	typedef uint32_t ResourceId;
+
+	struct Use
+	{
+		ResourceId resource;
+		RenderGraphAccess state;
+	};
+
+	//外部资源（交换链图像、间接绘制缓冲区等），initial是图开始执行时它所处的状态
+	ResourceId importImage( const std::string& name, VkImageAspectFlags aspect, const RenderGraphAccess& initial )
+	{
+		Resource resource;
+		resource.name = name;
+		resource.isImage = true;
+		resource.desc.aspect = aspect;
+		resource.initial = initial;
+		resources.push_back( resource );
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	ResourceId importBuffer( const std::string& name, const RenderGraphAccess& initial )
+	{
+		Resource resource;
+		resource.name = name;
+		resource.initial = initial;
+		resources.push_back( resource );
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	//由图创建和持有的临时图像，内容只在一次执行内有效
+	ResourceId createImage( const std::string& name, const RenderGraphImageDesc& desc )
+	{
+		Resource resource;
+		resource.name = name;
+		resource.isImage = true;
+		resource.transient = true;
+		resource.desc = desc;
+		resources.push_back( resource );
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	//资源在图外继续被使用（呈现、回读、其他队列），写它的pass不会被剔除，执行结束时转换到finalState
+	void setOutput( ResourceId resource, const RenderGraphAccess& finalState )
+	{
+		resources[resource].output = true;
+		resources[resource].final = finalState;
+	}
+
+	//同一个资源既读又写时只放在writes里，访问类型同时包含读写位
+	void addPass( const std::string& name, std::vector<Use> reads, std::vector<Use> writes, std::function<void( VkCommandBuffer )> record )
+	{
+		passes.push_back( { name, std::move( reads ), std::move( writes ), std::move( record ), false } );
+	}
+
+	//device为VK_NULL_HANDLE时不创建图像，按每像素4字节估算内存需求，自测用它检查剔除、屏障和别名
+	void compile( VkDevice device, GpuAllocator& allocator )
+	{
+		this->device = device;
+		stats = {};
+		stats.passCount = static_cast<uint32_t>(passes.size());
+
+		cullPasses();
+		computeLifetimes();
+		createTransients( allocator );
+		planBarriers();
+	}
+
+	//临时图像的销毁交给调用者（可能需要推迟到使用它们的帧完成之后）
+	void destroy( const std::function<void( VkImage, VkImageView )>& destroyImage, const std::function<void( GpuAllocation& )>& freeMemory )
+	{
+		for (Resource& resource : resources)
+		{
+			if (resource.transient && resource.image != VK_NULL_HANDLE)
+			{
+				destroyImage( resource.image, resource.view );
+			}
+		}
+		for (AliasSlot& slot : slots)
+		{
+			freeMemory( slot.memory );
+		}
+		resources.clear();
+		passes.clear();
+		slots.clear();
+		steps.clear();
+	}
+
+	void setImage( ResourceId resource, VkImage image )
+	{
+		resources[resource].image = image;
+	}
+
+	void setBuffer( ResourceId resource, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size )
+	{
+		resources[resource].buffer = buffer;
+		resources[resource].offset = offset;
+		resources[resource].size = size;
+	}
+
+	VkImageView getImageView( ResourceId resource ) const { return resources[resource].view; }
+	const RenderGraphStats& getStats() const { return stats; }
+
+	//按执行顺序列出全部屏障，被剔除的pass不出现
+	std::vector<RenderGraphBarrier> getBarrierPlan() const
+	{
+		std::vector<RenderGraphBarrier> plan;
+		for (const Step& step : steps)
+		{
+			for (const BarrierTemplate& barrier : step.barriers)
+			{
+				plan.push_back( { step.pass != NO_PASS ? passes[step.pass].name : std::string(), resources[barrier.resource].name,
+					step.srcStage, step.dstStage, barrier.srcAccess, barrier.dstAccess, barrier.oldLayout, barrier.newLayout } );
+			}
+		}
+		return plan;
+	}
+
+	void execute( VkCommandBuffer commandBuffer )
+	{
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		for (const Step& step : steps)
+		{
+			if (!step.barriers.empty())
+			{
+				bufferBarriers.clear();
+				imageBarriers.clear();
+				for (const BarrierTemplate& barrier : step.barriers)
+				{
+					const Resource& resource = resources[barrier.resource];
+					if (resource.isImage)
+					{
+						VkImageMemoryBarrier imageBarrier{};
+						imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+						imageBarrier.srcAccessMask = barrier.srcAccess;
+						imageBarrier.dstAccessMask = barrier.dstAccess;
+						imageBarrier.oldLayout = barrier.oldLayout;
+						imageBarrier.newLayout = barrier.newLayout;
+						imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						imageBarrier.image = resource.image;
+						imageBarrier.subresourceRange = { resource.desc.aspect, 0, 1, 0, 1 };
+						imageBarriers.push_back( imageBarrier );
+					}
+					else
+					{
+						VkBufferMemoryBarrier bufferBarrier{};
+						bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+						bufferBarrier.srcAccessMask = barrier.srcAccess;
+						bufferBarrier.dstAccessMask = barrier.dstAccess;
+						bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+						bufferBarrier.buffer = resource.buffer;
+						bufferBarrier.offset = resource.offset;
+						bufferBarrier.size = resource.size;
+						bufferBarriers.push_back( bufferBarrier );
+					}
+				}
+				vkCmdPipelineBarrier( commandBuffer, step.srcStage, step.dstStage, 0, 0, nullptr,
+					static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data() );
+			}
+			if (step.pass != NO_PASS)
+			{
+				passes[step.pass].record( commandBuffer );
+			}
+		}
+	}
+
+private:
+	static constexpr uint32_t NO_PASS = UINT32_MAX;
+
+	struct Resource
+	{
+		std::string name;
+		bool isImage = false;
+		bool transient = false;
+		bool output = false;
+		RenderGraphImageDesc desc;
+		RenderGraphAccess initial;
+		RenderGraphAccess final;
+		//临时图像的生命周期（编译后保留的pass序号）和使用过的全部阶段、写访问
+		uint32_t firstPass = NO_PASS;
+		uint32_t lastPass = 0;
+		VkPipelineStageFlags usedStages = 0;
+		VkAccessFlags writeAccess = 0;
+		uint32_t slot = NO_PASS;
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = VK_WHOLE_SIZE;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		std::vector<Use> reads;
+		std::vector<Use> writes;
+		std::function<void( VkCommandBuffer )> record;
+		bool culled;
+	};
+
+	//多个生命周期不重叠的临时图像绑定在同一段内存上，occupants按第一次使用的顺序排列
+	struct AliasSlot
+	{
+		std::vector<ResourceId> occupants;
+		VkMemoryRequirements requirements{};
+		GpuAllocation memory;
+	};
+
+	struct BarrierTemplate
+	{
+		ResourceId resource;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+	};
+
+	//在pass之前执行的屏障；最后一步没有pass，只把输出资源转换到最终状态
+	struct Step
+	{
+		uint32_t pass;
+		VkPipelineStageFlags srcStage = 0;
+		VkPipelineStageFlags dstStage = 0;
+		std::vector<BarrierTemplate> barriers;
+	};
+
+	//编译时对每个资源跟踪的同步状态
+	struct TrackedState
+	{
+		VkPipelineStageFlags producerStage = 0;//上一次写入或布局转换所在的阶段
+		VkAccessFlags producerAccess = 0;
+		bool pending = false;//上一次写入之后还有读取者没有和它同步
+		VkPipelineStageFlags readStages = 0;//上一次写入之后已经同步过的读取
+		VkAccessFlags readAccess = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<AliasSlot> slots;
+	std::vector<Step> steps;
+	RenderGraphStats stats;
+
+	//从输出资源反向传播：pass写入的资源都没有被后面的pass或图外使用时剔除
+	void cullPasses()
+	{
+		std::vector<bool> needed( resources.size(), false );
+		for (size_t i = 0; i < resources.size(); i++)
+		{
+			needed[i] = resources[i].output;
+		}
+
+		for (size_t i = passes.size(); i-- > 0;)
+		{
+			Pass& pass = passes[i];
+			pass.culled = std::none_of( pass.writes.begin(), pass.writes.end(), [&]( const Use& use ) { return needed[use.resource]; } );
+			if (pass.culled)
+			{
+				stats.culledPassCount++;
+				continue;
+			}
+			for (const Use& use : pass.reads)
+			{
+				needed[use.resource] = true;
+			}
+			for (const Use& use : pass.writes)
+			{
+				needed[use.resource] = true;
+			}
+		}
+	}
+
+	void computeLifetimes()
+	{
+		for (uint32_t i = 0; i < passes.size(); i++)
+		{
+			if (passes[i].culled)
+			{
+				continue;
+			}
+			for (const std::vector<Use>* uses : { &passes[i].reads, &passes[i].writes })
+			{
+				for (const Use& use : *uses)
+				{
+					Resource& resource = resources[use.resource];
+					resource.firstPass = std::min( resource.firstPass, i );
+					resource.lastPass = std::max( resource.lastPass, i );
+					resource.usedStages |= use.state.stage;
+					resource.writeAccess |= use.state.access & RENDER_GRAPH_WRITE_ACCESS;
+				}
+			}
+		}
+	}
+
+	//按第一次使用的顺序贪心分配：放进第一个已经空闲（上一个占用者的生命周期已结束）且内存类型兼容的槽位
+	void createTransients( GpuAllocator& allocator )
+	{
+		std::vector<ResourceId> transients;
+		for (ResourceId id = 0; id < resources.size(); id++)
+		{
+			if (resources[id].transient && resources[id].firstPass != NO_PASS)
+			{
+				transients.push_back( id );
+			}
+		}
+		std::sort( transients.begin(), transients.end(), [this]( ResourceId a, ResourceId b ) { return resources[a].firstPass < resources[b].firstPass; } );
+
+		for (ResourceId id : transients)
+		{
+			Resource& resource = resources[id];
+
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = resource.desc.format;
+			imageInfo.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = resource.desc.usage;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			VkMemoryRequirements requirements{};
+			if (device == VK_NULL_HANDLE)
+			{
+				requirements.size = static_cast<VkDeviceSize>(imageInfo.extent.width) * imageInfo.extent.height * 4;
+				requirements.alignment = 256;
+				requirements.memoryTypeBits = ~0u;
+			}
+			else
+			{
+				if (vkCreateImage( device, &imageInfo, nullptr, &resource.image ) != VK_SUCCESS)
+				{
+					throw std::runtime_error( "failed to create render graph image!" );
+				}
+				vkGetImageMemoryRequirements( device, resource.image, &requirements );
+			}
+			stats.transientImageCount++;
+			stats.transientBytesUnaliased += requirements.size;
+
+			uint32_t slotIndex = NO_PASS;
+			for (uint32_t i = 0; i < slots.size(); i++)
+			{
+				const Resource& last = resources[slots[i].occupants.back()];
+				if (last.lastPass < resource.firstPass && (slots[i].requirements.memoryTypeBits & requirements.memoryTypeBits) != 0)
+				{
+					slotIndex = i;
+					break;
+				}
+			}
+			if (slotIndex == NO_PASS)
+			{
+				slots.emplace_back();
+				slots.back().requirements = requirements;
+				slotIndex = static_cast<uint32_t>(slots.size() - 1);
+			}
+
+			AliasSlot& slot = slots[slotIndex];
+			slot.occupants.push_back( id );
+			slot.requirements.size = std::max( slot.requirements.size, requirements.size );
+			slot.requirements.alignment = std::max( slot.requirements.alignment, requirements.alignment );
+			slot.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+			resource.slot = slotIndex;
+		}
+
+		for (AliasSlot& slot : slots)
+		{
+			slot.memory = allocator.allocate( slot.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Image );
+			stats.transientBytes += slot.requirements.size;
+			for (ResourceId id : slot.occupants)
+			{
+				if (device == VK_NULL_HANDLE)
+				{
+					break;
+				}
+				Resource& resource = resources[id];
+				vkBindImageMemory( device, resource.image, slot.memory.memory, slot.memory.offset );
+
+				VkImageViewCreateInfo viewInfo{};
+				viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+				viewInfo.image = resource.image;
+				viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+				viewInfo.format = resource.desc.format;
+				viewInfo.subresourceRange = { resource.desc.aspect, 0, 1, 0, 1 };
+
+				if (vkCreateImageView( device, &viewInfo, nullptr, &resource.view ) != VK_SUCCESS)
+				{
+					throw std::runtime_error( "failed to create render graph image view!" );
+				}
+			}
+		}
+	}
+
+	//临时图像开始时要等待同一槽位的上一个占用者（第一个占用者等待上一次执行中的最后一个占用者），
+	//内容不保留，所以从UNDEFINED开始
+	TrackedState initialState( const Resource& resource ) const
+	{
+		TrackedState state;
+		if (resource.transient && resource.slot == NO_PASS)
+		{
+			return state;//只被剔除的pass使用，没有创建
+		}
+		if (resource.transient)
+		{
+			const std::vector<ResourceId>& occupants = slots[resource.slot].occupants;
+			size_t index = std::find( occupants.begin(), occupants.end(), &resource - resources.data() ) - occupants.begin();
+			const Resource& previous = resources[occupants[(index + occupants.size() - 1) % occupants.size()]];
+			state.producerStage = previous.usedStages;
+			state.producerAccess = previous.writeAccess;
+			state.pending = true;
+			return state;
+		}
+
+		state.producerStage = resource.initial.stage;
+		state.producerAccess = resource.initial.access & RENDER_GRAPH_WRITE_ACCESS;
+		state.pending = state.producerAccess != 0;
+		state.layout = resource.initial.layout;
+		return state;
+	}
+
+	//把use需要的屏障加到step里并更新state。写入（包括布局转换）要等待之前的读取（WAR，只需执行依赖），
+	//没有读取时等待之前的写入；读取只在有未同步的写入、且还没有对这个阶段和访问类型可见时需要屏障
+	void addBarrier( TrackedState& state, const Resource& resource, ResourceId id, const RenderGraphAccess& use, Step& step )
+	{
+		bool layoutChange = resource.isImage && state.layout != use.layout;
+		bool writes = (use.access & RENDER_GRAPH_WRITE_ACCESS) != 0 || layoutChange;
+
+		VkPipelineStageFlags srcStage;
+		VkAccessFlags srcAccess;
+		bool needed;
+		if (writes)
+		{
+			bool afterReads = state.readStages != 0;
+			srcStage = afterReads ? state.readStages : state.producerStage;
+			srcAccess = afterReads ? 0 : state.producerAccess;
+			needed = layoutChange || afterReads || state.pending;
+		}
+		else
+		{
+			srcStage = state.producerStage;
+			srcAccess = state.producerAccess;
+			needed = state.pending && ((use.stage & ~state.readStages) != 0 || (use.access & ~state.readAccess) != 0);
+		}
+
+		if (needed)
+		{
+			step.srcStage |= srcStage;
+			step.dstStage |= use.stage;
+			step.barriers.push_back( { id, srcAccess, use.access, state.layout, resource.isImage ? use.layout : VK_IMAGE_LAYOUT_UNDEFINED } );
+		}
+
+		if (writes)
+		{
+			state.producerStage = use.stage;
+			state.producerAccess = use.access & RENDER_GRAPH_WRITE_ACCESS;
+			state.pending = true;
+			state.readStages = state.producerAccess != 0 ? 0 : use.stage;//只有布局转换时这次读取已经和它同步
+			state.readAccess = state.producerAccess != 0 ? 0 : use.access;
+			state.layout = resource.isImage ? use.layout : state.layout;
+		}
+		else
+		{
+			state.readStages |= use.stage;
+			state.readAccess |= use.access;
+		}
+	}
+
+	void planBarriers()
+	{
+		std::vector<TrackedState> states( resources.size() );
+		for (size_t i = 0; i < resources.size(); i++)
+		{
+			states[i] = initialState( resources[i] );
+		}
+
+		for (uint32_t i = 0; i < passes.size(); i++)
+		{
+			if (passes[i].culled)
+			{
+				continue;
+			}
+			Step step;
+			step.pass = i;
+			for (const std::vector<Use>* uses : { &passes[i].reads, &passes[i].writes })
+			{
+				for (const Use& use : *uses)
+				{
+					addBarrier( states[use.resource], resources[use.resource], use.resource, use.state, step );
+				}
+			}
+			steps.push_back( std::move( step ) );
+		}
+
+		//最终状态不访问内存、布局也不变时（由信号量或呈现接管）不需要屏障
+		Step finalStep;
+		finalStep.pass = NO_PASS;
+		for (ResourceId id = 0; id < resources.size(); id++)
+		{
+			const Resource& resource = resources[id];
+			bool layoutChange = resource.isImage && states[id].layout != resource.final.layout;
+			if (resource.output && (resource.final.access != 0 || layoutChange))
+			{
+				addBarrier( states[id], resource, id, resource.final, finalStep );
+			}
+		}
+		steps.push_back( std::move( finalStep ) );
+
+		for (Step& step : steps)
+		{
+			if (!step.barriers.empty())
+			{
+				stats.barrierCount++;
+				step.srcStage = step.srcStage != 0 ? step.srcStage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			}
+		}
+	}
+};
+
+//--self-test：渲染图的CPU侧检查。两个生命周期不重叠的临时图像共享内存，
+//没有输出被使用的pass被剔除，第二个临时图像开始前等待第一个的最后一次读取
+uint32_t runRenderGraphSelfTest()
+{
+	uint32_t failures = 0;
+	auto check = [&failures]( bool condition, const char* name ) { selfTestCheck( failures, condition, name ); };
+
+	VkPhysicalDeviceMemoryProperties memProperties{};
+	memProperties.memoryTypeCount = 1;
+	memProperties.memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	memProperties.memoryHeapCount = 1;
+	memProperties.memoryHeaps[0].size = 8192ull * 1024 * 1024;
+	GpuAllocator allocator;
+	allocator.init( VK_NULL_HANDLE, memProperties, 1, 16, 1 );
+
+	const RenderGraphAccess colorWrite = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	const RenderGraphAccess shaderRead = { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	RenderGraphImageDesc desc;
+	desc.format = VK_FORMAT_R8G8B8A8_UNORM;
+	desc.extent = { 256, 256 };
+	desc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	RenderGraph graph;
+	auto backbuffer = graph.importImage( "backbuffer", VK_IMAGE_ASPECT_COLOR_BIT, {} );
+	graph.setOutput( backbuffer, { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR } );
+	auto first = graph.createImage( "first", desc );
+	auto second = graph.createImage( "second", desc );
+	auto unused = graph.createImage( "unused", desc );
+	auto noRecord = []( VkCommandBuffer ) {};
+	graph.addPass( "draw_first", {}, { { first, colorWrite } }, noRecord );
+	graph.addPass( "compose_first", { { first, shaderRead } }, { { backbuffer, colorWrite } }, noRecord );
+	graph.addPass( "debug_view", {}, { { unused, colorWrite } }, noRecord );
+	graph.addPass( "draw_second", {}, { { second, colorWrite } }, noRecord );
+	graph.addPass( "compose_second", { { second, shaderRead } }, { { backbuffer, colorWrite } }, noRecord );
+	graph.compile( VK_NULL_HANDLE, allocator );
+
+	const RenderGraphStats& stats = graph.getStats();
+	std::vector<RenderGraphBarrier> plan = graph.getBarrierPlan();
+	auto find = [&plan]( const std::string& pass, const std::string& resource ) -> const RenderGraphBarrier*
+		{
+			for (const RenderGraphBarrier& barrier : plan)
+			{
+				if (barrier.pass == pass && barrier.resource == resource)
+				{
+					return &barrier;
+				}
+			}
+			return nullptr;
+		};
+
+	check( stats.passCount == 5 && stats.culledPassCount == 1, "a pass whose output is never used is culled" );
+	check( std::none_of( plan.begin(), plan.end(), []( const RenderGraphBarrier& b ) { return b.pass == "debug_view"; } ),
+		"a culled pass gets no barriers" );
+	check( stats.transientImageCount == 2, "a culled pass's transient is never created" );
+	check( stats.transientBytesUnaliased == 2 * 256 * 256 * 4 && stats.transientBytes == 256 * 256 * 4,
+		"transients with disjoint lifetimes share one allocation" );
+
+	const RenderGraphBarrier* read = find( "compose_first", "first" );
+	check( read != nullptr && read->oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL && read->newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL &&
+		read->srcAccess == VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT && read->dstAccess == VK_ACCESS_SHADER_READ_BIT,
+		"reading an attachment transitions it and makes the write visible" );
+	const RenderGraphBarrier* alias = find( "draw_second", "second" );
+	check( alias != nullptr && alias->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && (alias->srcStage & VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT) != 0,
+		"an aliased transient waits for the previous occupant's last read" );
+	const RenderGraphBarrier* overwrite = find( "compose_second", "backbuffer" );
+	check( overwrite != nullptr && overwrite->srcAccess == VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT && overwrite->oldLayout == overwrite->newLayout,
+		"a second write to the same attachment orders after the first" );
+	const RenderGraphBarrier* present = find( "", "backbuffer" );
+	check( present != nullptr && present->newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, "outputs end in their final layout" );
+	check( stats.barrierCount == 5, "one barrier batch per executed pass plus the final transition" );
+
+	graph.destroy( []( VkImage, VkImageView ) {}, [&allocator]( GpuAllocation& memory ) { allocator.free( memory ); } );
+	check( allocator.getStats().allocationCount == 0, "destroy releases the aliased memory" );
+	allocator.destroy();
+
+	std::cout << (failures == 0 ? "render graph self-test passed" : "render graph self-test FAILED") << std::endl;
+	return failures;
+}
+
+//只读文件映射：按需分页读入，内容直接来自页缓存，没有读到用户缓冲区的复制。
+//sequential为true时提示内核顺序预读（整个读完的资源），否则提示随机访问（归档中按索引取用）
+class MappedFile
+{
+public:
+	MappedFile( const std::string& path, bool sequential )
+	{
+#ifdef _WIN32
+		file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+			sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, nullptr );
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error( "failed to open file " + path + "!" );
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx( file, &fileSize ))
+		{
+			close();
+			throw std::runtime_error( "failed to stat file " + path + "!" );
+		}
+		length = static_cast<size_t>(fileSize.QuadPart);
+		if (length == 0)
+		{
+			return;//空文件不能创建映射
+		}
+		mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		void* view = mapping ? MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) : nullptr;
+		if (view == nullptr)
+		{
+			close();
+			throw std::runtime_error( "failed to map file " + path + "!" );
+		}
+		if (sequential)
+		{
+			//FILE_FLAG_SEQUENTIAL_SCAN只影响ReadFile的预读，映射视图要显式预取，相当于MADV_WILLNEED
+			WIN32_MEMORY_RANGE_ENTRY range{ view, length };
+			PrefetchVirtualMemory( GetCurrentProcess(), 1, &range, 0 );
+		}
+		address = static_cast<const char*>(view);
+#else
+		int fd = ::open( path.c_str(), O_RDONLY );
+		if (fd < 0)
+		{
+			throw std::runtime_error( "failed to open file " + path + "!" );
+		}
+		struct stat info;
+		if (fstat( fd, &info ) != 0)
+		{
+			::close( fd );
+			throw std::runtime_error( "failed to stat file " + path + "!" );
+		}
+		length = static_cast<size_t>(info.st_size);
+		if (length == 0)
+		{
+			::close( fd );
+			return;
+		}
+		void* view = mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+		::close( fd );//映射保持对文件的引用
+		if (view == MAP_FAILED)
+		{
+			throw std::runtime_error( "failed to map file " + path + "!" );
+		}
+		//advice不是位标志，顺序读取时分两次提示：顺序预读，并立即开始读入
+		madvise( view, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM );
+		if (sequential)
+		{
+			madvise( view, length, MADV_WILLNEED );
+		}
+		address = static_cast<const char*>(view);
+#endif
+	}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+
+	//映射按页对齐，满足SPIR-V的4字节对齐要求
+	const char* data() const { return address; }
+	size_t size() const { return length; }
+
+private:
+	void close()
+	{
+#ifdef _WIN32
+		if (address != nullptr)
+		{
+			UnmapViewOfFile( address );
+		}
+		if (mapping != nullptr)
+		{
+			CloseHandle( mapping );
+		}
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle( file );
+		}
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (address != nullptr)
+		{
+			munmap( const_cast<char*>(address), length );
+		}
+#endif
+		address = nullptr;
+	}
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+	const char* address = nullptr;
+	size_t length = 0;
+};
+
+//一段资源数据：指向文件映射内部，持有映射的引用，映射在最后一个引用释放时解除
+struct AssetData
+{
+	std::shared_ptr<const MappedFile> mapping;
+	const char* data = nullptr;
+	size_t size = 0;
+};
+
+//资源归档：启动时打开并映射一次，之后按名字取用，没有逐文件的打开和读取。
+//布局：文件头（标识符、条目数），条目数个PakEntry组成的索引，16字节对齐的文件数据
+class AssetArchive
+{
+public:
+	void open( const std::string& path )
+	{
+		auto file = std::make_shared<const MappedFile>( path, false );
+		PakHeader header;
+		if (file->size() < sizeof( header ))
+		{
+			throw std::runtime_error( "asset archive is truncated!" );
+		}
+		std::memcpy( &header, file->data(), sizeof( header ) );
+		if (std::memcmp( header.magic, PAK_MAGIC, sizeof( header.magic ) ) != 0 ||
+			file->size() < sizeof( header ) + static_cast<size_t>(header.entryCount) * sizeof( PakEntry ))
+		{
+			throw std::runtime_error( "not an asset archive!" );
+		}
+
+		std::lock_guard<std::mutex> lock( mutex );
+		entries.clear();
+		for (uint32_t i = 0; i < header.entryCount; i++)
+		{
+			PakEntry entry;
+			std::memcpy( &entry, file->data() + sizeof( header ) + i * sizeof( PakEntry ), sizeof( entry ) );
+			if (entry.offset > file->size() || entry.size > file->size() - entry.offset)
+			{
+				throw std::runtime_error( "asset archive entry out of range!" );
+			}
+			entry.name[sizeof( entry.name ) - 1] = '\0';
+			entries[entry.name] = { file, file->data() + entry.offset, static_cast<size_t>(entry.size) };
+		}
+	}
+
+	//可以在任何线程上调用
+	bool find( const std::string& name, AssetData& asset ) const
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		auto it = entries.find( normalize( name ) );
+		if (it == entries.end())
+		{
+			return false;
+		}
+		asset = it->second;
+		return true;
+	}
+
+	//磁盘上的文件被重新生成（着色器热重载）后，以后的查找回到磁盘
+	void remove( const std::string& name )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		entries.erase( normalize( name ) );
+	}
+
+	size_t getEntryCount() const
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		return entries.size();
+	}
+
+	//把files按给定的名字打包，名字就是运行时查找用的路径
+	static void write( const std::string& path, const std::vector<std::string>& files )
+	{
+		PakHeader header{};
+		std::memcpy( header.magic, PAK_MAGIC, sizeof( header.magic ) );
+		header.entryCount = static_cast<uint32_t>(files.size());
+
+		std::vector<PakEntry> index( files.size() );
+		std::vector<std::shared_ptr<const MappedFile>> contents;
+		uint64_t offset = sizeof( header ) + files.size() * sizeof( PakEntry );
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			std::string name = normalize( files[i] );
+			if (name.size() >= sizeof( index[i].name ))
+			{
+				throw std::runtime_error( "asset name too long for archive: " + name );
+			}
+			contents.push_back( std::make_shared<const MappedFile>( files[i], true ) );
+			offset = (offset + PAK_ALIGNMENT - 1) & ~(PAK_ALIGNMENT - 1);
+			index[i].offset = offset;
+			index[i].size = contents[i]->size();
+			std::memcpy( index[i].name, name.c_str(), name.size() + 1 );
+			offset += index[i].size;
+		}
+
+		std::ofstream output( path, std::ios::binary | std::ios::trunc );
+		output.write( reinterpret_cast<const char*>(&header), sizeof( header ) );
+		output.write( reinterpret_cast<const char*>(index.data()), index.size() * sizeof( PakEntry ) );
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			const char padding[PAK_ALIGNMENT] = {};
+			output.write( padding, static_cast<std::streamsize>(index[i].offset - static_cast<uint64_t>(output.tellp())) );
+			output.write( contents[i]->data(), static_cast<std::streamsize>(contents[i]->size()) );
+		}
+		if (!output)
+		{
+			throw std::runtime_error( "failed to write asset archive!" );
+		}
+	}
+
+private:
+	static constexpr char PAK_MAGIC[8] = { 'V', 'K', 'P', 'A', 'K', '0', '0', '1' };
+	static constexpr uint64_t PAK_ALIGNMENT = 16;//纹理暂存按16字节对齐，SPIR-V需要4字节
+
+	struct PakHeader
+	{
+		char magic[8];
+		uint32_t entryCount;
+		uint32_t reserved;
+	};
+
+	struct PakEntry
+	{
+		uint64_t offset;//相对归档开头
+		uint64_t size;
+		char name[112];
+	};
+
+	static std::string normalize( const std::string& name )
+	{
+		return std::filesystem::path( name ).lexically_normal().generic_string();
+	}
+
+	std::unordered_map<std::string, AssetData> entries;
+	mutable std::mutex mutex;
+};
+
+//解码后的图像：各mip级别的数据依次存放在data中，级别0最大
+struct DecodedImage
+{
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	AssetData source;//KTX2的级别直接指向文件映射，不经过中间缓冲区
+	std::vector<char> pixels;//stb_image或CPU回退解码的结果，非空时级别偏移相对它
+	std::vector<VkDeviceSize> levelOffsets;
+	std::vector<VkDeviceSize> levelSizes;
+	bool generateMips = false;//文件只带级别0，其余级别在上传时生成
+
+	const char* levelData( size_t level ) const
+	{
+		return (pixels.empty() ? source.data : pixels.data()) + levelOffsets[level];
+	}
+};
+
+//KTX2容器：只支持无超压缩的单层2D纹理，vkFormat直接用作图像格式。levelCount为0表示需要运行时生成mip
+void decodeKtx2( const AssetData& file, DecodedImage& image )
+{
+	const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	const size_t headerSize = 80;//标识符、9个uint32字段和索引区
+	auto read32 = [&file]( size_t offset ) { uint32_t value; std::memcpy( &value, file.data + offset, sizeof( value ) ); return value; };
+	auto read64 = [&file]( size_t offset ) { uint64_t value; std::memcpy( &value, file.data + offset, sizeof( value ) ); return value; };
+
+	if (file.size < headerSize || std::memcmp( file.data, identifier, sizeof( identifier ) ) != 0)
+	{
+		throw std::runtime_error( "not a KTX2 file!" );
+	}
+	uint32_t vkFormat = read32( 12 );
+	uint32_t pixelWidth = read32( 20 );
+	uint32_t pixelHeight = read32( 24 );
+	uint32_t pixelDepth = read32( 28 );
+	uint32_t layerCount = read32( 32 );
+	uint32_t faceCount = read32( 36 );
+	uint32_t levelCount = std::max( read32( 40 ), 1u );
+	image.generateMips = read32( 40 ) == 0;//levelCount为1表示确实只有一个级别
+	uint32_t supercompressionScheme = read32( 44 );
+	if (vkFormat == VK_FORMAT_UNDEFINED || supercompressionScheme != 0)
+	{
+		throw std::runtime_error( "unsupported KTX2 payload (Basis Universal or supercompressed)!" );
+	}
+	if (pixelWidth == 0 || pixelHeight == 0 || pixelDepth > 1 || layerCount > 1 || faceCount != 1)
+	{
+		throw std::runtime_error( "only single-layer 2D KTX2 textures are supported!" );
+	}
+	if (file.size < headerSize + levelCount * 24ull)
+	{
+		throw std::runtime_error( "truncated KTX2 level index!" );
+	}
+
+	image.format = static_cast<VkFormat>(vkFormat);
+	image.width = pixelWidth;
+	image.height = pixelHeight;
+	image.source = file;
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		uint64_t byteOffset = read64( headerSize + level * 24 );
+		uint64_t byteLength = read64( headerSize + level * 24 + 8 );
+		if (byteOffset > file.size || byteLength > file.size - byteOffset)
+		{
+			throw std::runtime_error( "truncated KTX2 level data!" );
+		}
+		image.levelOffsets.push_back( byteOffset );
+		image.levelSizes.push_back( byteLength );
+	}
+}
+
+//KTX2直接解析，其他格式（PNG等）交给stb_image，统一转成RGBA8
+void decodeImage( const AssetData& file, DecodedImage& image )
+{
+	if (file.size >= 12 && static_cast<unsigned char>(file.data[0]) == 0xAB && file.data[1] == 'K')
+	{
+		decodeKtx2( file, image );
+		return;
+	}
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load_from_memory( reinterpret_cast<const stbi_uc*>(file.data), static_cast<int>(file.size), &width, &height, &channels, STBI_rgb_alpha );
+	if (pixels == nullptr)
+	{
+		throw std::runtime_error( std::string( "failed to decode image: " ) + stbi_failure_reason() );
+	}
+	image.format = VK_FORMAT_R8G8B8A8_SRGB;
+	image.width = static_cast<uint32_t>(width);
+	image.height = static_cast<uint32_t>(height);
+	image.pixels.assign( reinterpret_cast<char*>(pixels), reinterpret_cast<char*>(pixels) + static_cast<size_t>(width) * height * 4 );
+	image.levelOffsets = { 0 };
+	image.levelSizes = { image.pixels.size() };
+	image.generateMips = true;
+	stbi_image_free( pixels );
+}
+
+//块压缩格式：BC、ETC2/EAC和ASTC在VkFormat中是连续的一段
+bool isBlockCompressed( VkFormat format )
+{
+	return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+}
+
+const char* textureFormatName( VkFormat format )
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM: return "rgba8";
+	case VK_FORMAT_R8G8B8A8_SRGB: return "rgba8_srgb";
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK: case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: return "bc1";
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK: case VK_FORMAT_BC1_RGBA_SRGB_BLOCK: return "bc1_srgb";
+	case VK_FORMAT_BC2_UNORM_BLOCK: return "bc2";
+	case VK_FORMAT_BC2_SRGB_BLOCK: return "bc2_srgb";
+	case VK_FORMAT_BC3_UNORM_BLOCK: return "bc3";
+	case VK_FORMAT_BC3_SRGB_BLOCK: return "bc3_srgb";
+	case VK_FORMAT_BC4_UNORM_BLOCK: return "bc4";
+	case VK_FORMAT_BC5_UNORM_BLOCK: return "bc5";
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK: case VK_FORMAT_BC6H_SFLOAT_BLOCK: return "bc6h";
+	case VK_FORMAT_BC7_UNORM_BLOCK: return "bc7";
+	case VK_FORMAT_BC7_SRGB_BLOCK: return "bc7_srgb";
+	default: return isBlockCompressed( format ) ? "compressed" : "other";
+	}
+}
+
+//BC1的颜色块，BC2/BC3的颜色部分也是同样的编码但总是四色模式
+void decodeBcColorBlock( const uint8_t* block, uint8_t* pixels, size_t rowPitch, bool alwaysFourColor )
+{
+	uint16_t c0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+	uint16_t c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+	uint8_t colors[4][4];
+	auto expand565 = []( uint16_t c, uint8_t* out )
+		{
+			out[0] = static_cast<uint8_t>(((c >> 11) & 31) * 255 / 31);
+			out[1] = static_cast<uint8_t>(((c >> 5) & 63) * 255 / 63);
+			out[2] = static_cast<uint8_t>((c & 31) * 255 / 31);
+			out[3] = 255;
+		};
+	expand565( c0, colors[0] );
+	expand565( c1, colors[1] );
+	for (int i = 0; i < 3; i++)
+	{
+		if (alwaysFourColor || c0 > c1)
+		{
+			colors[2][i] = static_cast<uint8_t>((2 * colors[0][i] + colors[1][i]) / 3);
+			colors[3][i] = static_cast<uint8_t>((colors[0][i] + 2 * colors[1][i]) / 3);
+		}
+		else
+		{
+			colors[2][i] = static_cast<uint8_t>((colors[0][i] + colors[1][i]) / 2);
+			colors[3][i] = 0;
+		}
+	}
+	colors[2][3] = 255;
+	colors[3][3] = (alwaysFourColor || c0 > c1) ? 255 : 0;//三色模式的第四种颜色是透明黑
+
+	uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		std::memcpy( pixels + (i / 4) * rowPitch + (i % 4) * 4, colors[(indices >> (2 * i)) & 3], 4 );
+	}
+}
+
+//BC3的alpha、BC4和BC5的单个通道：两个端点加16个3位下标
+void decodeBcChannelBlock( const uint8_t* block, uint8_t* pixels, size_t rowPitch, uint32_t channel )
+{
+	uint8_t values[8];
+	values[0] = block[0];
+	values[1] = block[1];
+	if (values[0] > values[1])
+	{
+		for (int i = 1; i < 7; i++)
+		{
+			values[i + 1] = static_cast<uint8_t>(((7 - i) * values[0] + i * values[1]) / 7);
+		}
+	}
+	else
+	{
+		for (int i = 1; i < 5; i++)
+		{
+			values[i + 1] = static_cast<uint8_t>(((5 - i) * values[0] + i * values[1]) / 5);
+		}
+		values[6] = 0;
+		values[7] = 255;
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+	}
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		pixels[(i / 4) * rowPitch + (i % 4) * 4 + channel] = values[(indices >> (3 * i)) & 7];
+	}
+}
+
+//设备不支持的BC1-BC5在CPU上解码成RGBA8，保留文件中的全部mip级别。其他压缩格式没有CPU实现
+void decodeBlockCompressedToRgba8( DecodedImage& image )
+{
+	VkFormat format = image.format;
+	bool srgb = format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+		format == VK_FORMAT_BC2_SRGB_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK;
+	size_t blockSize;
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK: case VK_FORMAT_BC1_RGB_SRGB_BLOCK: case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+		blockSize = 8;
+		break;
+	case VK_FORMAT_BC2_UNORM_BLOCK: case VK_FORMAT_BC2_SRGB_BLOCK: case VK_FORMAT_BC3_UNORM_BLOCK: case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+		blockSize = 16;
+		break;
+	default:
+		throw std::runtime_error( std::string( "no CPU fallback for texture format " ) + textureFormatName( format ) + "!" );
+	}
+
+	std::vector<char> data;
+	std::vector<VkDeviceSize> levelOffsets;
+	std::vector<VkDeviceSize> levelSizes;
+	for (size_t level = 0; level < image.levelOffsets.size(); level++)
+	{
+		uint32_t width = std::max( image.width >> level, 1u );
+		uint32_t height = std::max( image.height >> level, 1u );
+		uint32_t blocksX = (width + 3) / 4;
+		uint32_t blocksY = (height + 3) / 4;
+		if (image.levelSizes[level] < static_cast<VkDeviceSize>(blocksX) * blocksY * blockSize)
+		{
+			throw std::runtime_error( "truncated block-compressed level!" );
+		}
+
+		//按整块解码到临时图像，再裁掉不足4像素的边缘
+		size_t rowPitch = static_cast<size_t>(blocksX) * 4 * 4;
+		std::vector<uint8_t> blocks( rowPitch * blocksY * 4, 0 );
+		const uint8_t* source = reinterpret_cast<const uint8_t*>(image.levelData( level ));
+		for (uint32_t by = 0; by < blocksY; by++)
+		{
+			for (uint32_t bx = 0; bx < blocksX; bx++)
+			{
+				const uint8_t* block = source + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+				uint8_t* pixels = blocks.data() + static_cast<size_t>(by) * 4 * rowPitch + bx * 16;
+				switch (format)
+				{
+				case VK_FORMAT_BC1_RGB_UNORM_BLOCK: case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+					decodeBcColorBlock( block, pixels, rowPitch, false );
+					for (uint32_t i = 0; i < 16; i++)
+					{
+						pixels[(i / 4) * rowPitch + (i % 4) * 4 + 3] = 255;//RGB格式忽略透明
+					}
+					break;
+				case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+					decodeBcColorBlock( block, pixels, rowPitch, false );
+					break;
+				case VK_FORMAT_BC2_UNORM_BLOCK: case VK_FORMAT_BC2_SRGB_BLOCK:
+					decodeBcColorBlock( block + 8, pixels, rowPitch, true );
+					for (uint32_t i = 0; i < 16; i++)
+					{
+						pixels[(i / 4) * rowPitch + (i % 4) * 4 + 3] = static_cast<uint8_t>(((block[i / 2] >> (4 * (i % 2))) & 15) * 17);
+					}
+					break;
+				case VK_FORMAT_BC3_UNORM_BLOCK: case VK_FORMAT_BC3_SRGB_BLOCK:
+					decodeBcColorBlock( block + 8, pixels, rowPitch, true );
+					decodeBcChannelBlock( block, pixels, rowPitch, 3 );
+					break;
+				case VK_FORMAT_BC4_UNORM_BLOCK:
+					decodeBcChannelBlock( block, pixels, rowPitch, 0 );
+					break;
+				default:
+					decodeBcChannelBlock( block, pixels, rowPitch, 0 );
+					decodeBcChannelBlock( block + 8, pixels, rowPitch, 1 );
+					break;
+				}
+				if (format == VK_FORMAT_BC4_UNORM_BLOCK || format == VK_FORMAT_BC5_UNORM_BLOCK)
+				{
+					for (uint32_t i = 0; i < 16; i++)
+					{
+						pixels[(i / 4) * rowPitch + (i % 4) * 4 + 3] = 255;
+					}
+				}
+			}
+		}
+
+		VkDeviceSize offset = alignUp( data.size(), 16 );
+		VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+		data.resize( static_cast<size_t>(offset + size) );
+		for (uint32_t y = 0; y < height; y++)
+		{
+			std::memcpy( data.data() + offset + static_cast<size_t>(y) * width * 4, blocks.data() + y * rowPitch, static_cast<size_t>(width) * 4 );
+		}
+		levelOffsets.push_back( offset );
+		levelSizes.push_back( size );
+	}
+
+	image.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+	image.source = {};
+	image.pixels = std::move( data );
+	image.levelOffsets = std::move( levelOffsets );
+	image.levelSizes = std::move( levelSizes );
+}
+
+class HelloTriangleApplication
+{
+public:
+	HelloTriangleApplication( const AppConfig& config, Scene scene )
+		: config( config ), pacingPolicy( getFramePacingPolicy( config.pacing ) ), scene( std::move( scene ) ), mesh( this->scene.mesh )
+	{
+		maxFramesInFlight = config.framesInFlight > 0 ? config.framesInFlight : pacingPolicy.framesInFlight;
+	}
+
+	const std::vector<FrameTimings>& getFrameTimings() const { return frameTimings; }
+
+	void run()
+	{
+		startupBegin = std::chrono::steady_clock::now();
+		if (!config.headless)
+		{
+			initWindow();
+		}
+		initVulkan();
+		mainLoop();
+		cleanup();
+	}
+
+private:
+	AppConfig config;
+	FramePacingPolicy pacingPolicy;
+	uint32_t maxFramesInFlight;//多帧飞行提高吞吐量，但输入到显示的延迟也随之增加
+	VkPresentModeKHR swapChainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	std::chrono::steady_clock::time_point inputSampleTime;//本帧glfwPollEvents的时刻
+	Scene scene;
+	const Mesh& mesh;
+
+	GLFWwindow* window = nullptr;
+
+	VkInstance instance;
+	VkDebugUtilsMessengerEXT debugMessenger;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;//headless模式下为空
+	// physicalDevice将在销毁 VkInstance 时隐式销毁
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device;//logical device
+	VkQueue graphicsQueue;
+	VkQueue presentQueue;
+	//异步上传：传输队列复制并释放所有权，之后第一个图形帧获取所有权并等待transferTimeline
+	struct PendingAcquire
+	{
+		bool isImage;
+		VkBufferMemoryBarrier bufferBarrier;
+		VkImageMemoryBarrier imageBarrier;
+		VkPipelineStageFlags dstStage;
+		uint64_t transferValue;//传输提交完成时transferTimeline的值
+		std::function<void()> release;//回收暂存缓冲区和传输命令缓冲区
+	};
+	//异步计算：剔除录制在计算队列的命令缓冲区里，第N帧的剔除可以与第N-1帧的图形工作同时执行，
+	//图形提交在DRAW_INDIRECT阶段等待computeTimeline = frameCounter + 1
+	VkQueue computeQueue = VK_NULL_HANDLE;
+	VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> computeCommandBuffers;
+	VkSemaphore computeTimeline = VK_NULL_HANDLE;
+	uint32_t computeFamily = 0;
+	bool cullTimestampsSupported = false;//剔除所在队列族支持时间戳
+	//图形队列每帧执行frameGraph；异步计算时剔除的pass放在computeGraph里，在计算队列上执行
+	RenderGraph frameGraph;
+	RenderGraph computeGraph;
+	RenderGraph::ResourceId backbufferResource = 0;
+	RenderGraph::ResourceId drawCommandsResource = 0;
+	RenderGraph::ResourceId computeDrawCommandsResource = 0;
+	uint32_t frameImageIndex = 0;//本帧渲染的交换链图像，供场景pass使用
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+	VkSemaphore transferTimeline = VK_NULL_HANDLE;
+	uint64_t transferTimelineValue = 0;
+	uint32_t transferFamily = 0;
+	uint32_t graphicsFamily = 0;
+	std::mutex uploadMutex;//上传可能来自工作线程，保护传输命令池、传输队列和pendingAcquires
+	std::vector<PendingAcquire> pendingAcquires;
+	std::vector<PendingAcquire> frameAcquires;//本帧录制了获取屏障的上传
+	uint64_t frameUploadWaitValue = 0;
+	VkPipelineStageFlags frameUploadWaitStages = 0;
+	uint64_t asyncUploadCount = 0;
+	VkDeviceSize asyncUploadBytes = 0;
+	//纹理：加载线程解码并复制到图像（有传输队列时在传输队列上），获取所有权的图形帧生成mip并转换到着色器只读布局
+	struct Texture
+	{
+		VkImage image = VK_NULL_HANDLE;
+		GpuAllocation memory;
+		VkImageView view = VK_NULL_HANDLE;
+		bool resident = false;//mip已经生成，可以采样
+		uint32_t bindlessIndex = 0;//bindless模式下在纹理数组中的下标，就绪时注册
+	};
+	struct TextureUpload
+	{
+		uint32_t texture;
+		VkImage image;
+		GpuAllocation memory;
+		VkImageView view;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+		uint32_t levelsProvided;//文件中自带的级别，其余用vkCmdBlitImage生成
+		std::vector<VkBufferImageCopy> regions;
+		VkDeviceSize size;//文件中自带级别的字节数
+		VkFormat format;
+		bool cpuFallback;//文件是块压缩格式但设备不支持，已经解码成RGBA8
+		double decodeMs;
+		std::chrono::steady_clock::time_point requested;
+		StagingRing::Allocation staging;
+		bool copied;//复制已经在传输队列上完成，否则在图形帧里复制
+	};
+	std::vector<Texture> textures;//只在主线程上访问，textures[0]是占位纹理
+	uint32_t materialTexture = 0;
+	VkSampler textureSampler = VK_NULL_HANDLE;
+	VkBuffer textureStagingBuffer = VK_NULL_HANDLE;
+	GpuAllocation textureStagingMemory;
+	StagingRing textureStaging;
+	WorkerPool textureLoader;
+	std::vector<TextureUpload> pendingTextureUploads;//受uploadMutex保护
+	std::vector<TextureUpload> frameTextureUploads;
+	//资源：归档只在启动时打开一次，其余资源逐个映射
+	AssetArchive assetArchive;
+	std::atomic<uint32_t> assetArchiveHits = 0;
+	std::atomic<uint32_t> assetFileMaps = 0;
+	std::atomic<uint32_t> textureLoadFailures = 0;
+	uint32_t texturesLoaded = 0;
+	//pickPhysicalDevice中确定、加载线程启动后只读：设备可以直接采样的块压缩格式，其余在CPU上解码
+	std::set<VkFormat> compressedFormats;
+	bool textureCompressionBC = false;
+	bool textureCompressionETC2 = false;
+	bool textureCompressionASTC = false;
+	VkFormat textureFormat = VK_FORMAT_UNDEFINED;//最近一个就绪的纹理在GPU上的格式
+	VkDeviceSize textureGpuBytes = 0;//纹理图像实际占用的显存
+	VkDeviceSize textureRgba8Bytes = 0;//同样的纹理全部用RGBA8存放时需要的显存
+	uint32_t textureCpuFallbacks = 0;
+	double textureDecodeMs = 0.0;//加载线程上读文件、解码（包括CPU回退）的时间
+	double textureUploadMs = 0.0;//请求到纹理可以采样的时间
+	VkDeviceSize textureUploadBytes = 0;
+	uint64_t texturePlaceholderFrames = 0;//材质纹理还没就绪、采样占位纹理的帧数
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+	//被替换的交换链，上面的呈现可能还没完成。帧栅栏只覆盖渲染，不覆盖呈现，
+	//要等新交换链上第一次呈现的图像被再次获取（呈现按顺序完成，之前的呈现都已结束）才能销毁
+	std::vector<VkSwapchainKHR> retiredSwapChains;
+	std::optional<uint32_t> retireMarkerImage;
+	//swap chain image handle
+	//automatically destroyed after swap chain being destroyed
+	std::vector<VkImage> swapChainImages;
+	VkFormat swapChainImageFormat;
+	VkExtent2D swapChainExtent;//交换链图像尺寸
+	std::vector<VkImageView> swapChainImageViews;
+	//headless模式下swapChainImages由我们自己创建，需要手动释放内存
+	std::vector<GpuAllocation> offscreenImageMemory;
+	std::vector<VkFramebuffer> swapChainFramebuffers;
+	VkRenderPass renderPass = VK_NULL_HANDLE;//动态渲染路径下不创建
+	VkDescriptorSetLayout descriptorSetLayout;
+	DescriptorAllocator frameDescriptors;
+	VkDescriptorSet descriptorSet;//每帧从frameDescriptors分配。两个动态uniform缓冲区都指向uploadRing，每次绘制只改动态偏移
+	//bindless：所有缓冲区和纹理放在一个集合的大数组里，录制期间仍可写入新的元素
+	bool bindlessSupported = false;
+	VkDescriptorSetLayout bindlessSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool bindlessPool = VK_NULL_HANDLE;
+	VkDescriptorSet bindlessSet = VK_NULL_HANDLE;
+	uint32_t bindlessBufferCount = 0;
+	uint32_t bindlessTextureCount = 0;
+	uint32_t objectBufferIndex = 0;//uploadRing在bindless缓冲区数组中的下标
+	VkPipelineLayout pipelineLayout;
+	VkPipeline graphicsPipeline;//基础变体（不混合、背面剔除），也是后台编译期间的备用管线
+	PipelineManager pipelineManager;
+	VkPipeline activePipeline = VK_NULL_HANDLE;//本帧绘制使用的管线，录制前选定
+	uint64_t pipelineFallbackFrames = 0;//想要的变体还没就绪、用备用管线绘制的帧数
+	ShaderWatcher shaderWatcher;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	VkCommandPool commandPool;
+	std::vector<VkCommandBuffer> commandBuffers;
+	//每个工作线程在每个飞行中的帧都有自己的命令池和二级命令缓冲区，下标为 帧 * 线程数 + 线程
+	WorkerPool recordWorkers;
+	std::vector<VkCommandPool> workerCommandPools;
+	std::vector<VkCommandBuffer> workerCommandBuffers;
+	GpuAllocator allocator;
+	VkBuffer vertexBuffer;
+	GpuAllocation vertexBufferMemory;
+	VkBuffer indexBuffer;
+	GpuAllocation indexBufferMemory;
+	VkBuffer uploadRingBuffer;
+	GpuAllocation uploadRingMemory;
+	UploadRing uploadRing;
+	VkDeviceSize uniformAlignment = 256;//minUniformBufferOffsetAlignment
+	VkDeviceSize frameConstantsOffset = 0;//本帧数据在uploadRing中的偏移
+	VkDeviceSize objectConstantsOffset = 0;
+	VkDeviceSize objectConstantsStride = 0;
+	std::vector<ObjectConstants> objectConstants;//push constant模式下本帧的逐对象常量，录制时只读
+	VkDeviceSize instanceDataOffset = 0;
+	VkDeviceSize storageAlignment = 256;//minStorageBufferOffsetAlignment
+	glm::mat4 viewProj = glm::mat4( 1.0f );//本帧的相机矩阵，剔除时用来提取视锥平面
+	//GPU剔除
+	uint32_t deviceApiVersion = VK_API_VERSION_1_0;
+	bool multiDrawIndirectSupported = false;
+	bool drawIndirectCountSupported = false;//Vulkan 1.2的drawIndirectCount特性，没有时不压缩命令
+	VkDescriptorSetLayout cullDescriptorSetLayout;
+	VkDescriptorSet cullDescriptorSet;//每帧从frameDescriptors分配
+	VkPipelineLayout cullPipelineLayout;
+	VkPipeline cullPipeline;
+	VkBuffer drawCommandBuffer;//每个飞行中的帧一段区域，由剔除着色器写入
+	GpuAllocation drawCommandBufferMemory;
+	VkDeviceSize drawCommandRegionSize = 0;
+	float meshBoundingRadius = 0.0f;
+	std::vector<VkSemaphore> imageAvailableSemaphores;//表示已从交换链获取图像并准备好进行渲染
+	std::vector<VkSemaphore> renderFinishedSemaphores;//表示渲染已完成并且可以进行呈现
+	std::vector<VkFence> inFlightFences;//确保一次只渲染一帧（栅栏模式）
+	VkSemaphore graphicsTimeline = VK_NULL_HANDLE;//时间线模式：每次提交帧i时发出值i+1
+	bool timelineSemaphoreSupported = false;
+	bool dynamicRenderingSupported = false;
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;//每个飞行中的帧占TIMESTAMPS_PER_FRAME个查询
+	bool timestampsSupported = false;
+	float timestampPeriod = 1.0f;//一个时间戳单位对应的纳秒数
+	uint64_t timestampMask = ~0ULL;//按timestampValidBits截断
+	std::vector<uint64_t> timestampFrames;//每个槽位上次写入时间戳的帧号，UINT64_MAX表示没有待读取的结果
+	uint32_t currentFrame = 0;
+	uint64_t frameCounter = 0;//已提交的帧数
+	bool framebufferResized = false;
+	//以帧号为键，帧的栅栏发出信号后销毁该帧之前被替换的资源
+	DeletionQueue deletionQueue;
+	std::vector<double> swapChainRecreateMs;
+	uint64_t lastResizeFrame = 0;
+	std::vector<FrameTimings> frameTimings;//benchmark模式下预热后每帧的耗时
+	//启动耗时：冷启动（无有效缓存）和热启动（缓存命中）分别统计
+	std::chrono::steady_clock::time_point startupBegin;
+	bool pipelineCacheWarm = false;
+	uint32_t pipelineCount = 0;
+	double pipelineCreationMs = 0.0;
+	double timeToFirstFrameMs = 0.0;
+
+	void initWindow()
+	{
+		glfwInit();
+		//tell glfw do not use OPENGL
+		glfwWindowHint( GLFW_CLIENT_API, GLFW_NO_API );
+		//create window
+		window = glfwCreateWindow( WIDTH, HEIGHT, "Vulkan", nullptr, nullptr );
+		glfwSetWindowUserPointer( window, this );
+		glfwSetFramebufferSizeCallback( window, framebufferResizeCallback );//glfwPollEvents()触发事件
+	}
+
+	static void framebufferResizeCallback( GLFWwindow* window, int width, int height )
+	{
+		auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer( window ));
+		app->framebufferResized = true;
+	}
+
+	void initVulkan()
+	{
+		createInstance();
+		setupDebugMessenger();
+		createSurface();
+		pickPhysicalDevice();
+		createLogicalDevice();
+		allocator.init( physicalDevice, device, maxFramesInFlight );
+		if (!config.assetArchivePath.empty())
+		{
+			assetArchive.open( config.assetArchivePath );
+		}
+		createPipelineCache();
+		createSwapChain();
+		createImageViews();
+		createRenderPass();
+		createDescriptorSetLayout();
+		createGraphicsPipeline();
+		createCullPipeline();
+		createFramebuffers();
+		createCommandPool();
+		createTransferResources();
+		createComputeResources();
+		createVertexBuffer();
+		createIndexBuffer();
+		createUploadRing();
+		createTextureResources();
+		createDrawCommandBuffer();
+		createDescriptorAllocators();
+		createCommandBuffers();
+		createWorkerCommandBuffers();
+		createTimestampQueryPool();
+		createSyncObjects();
+		buildRenderGraphs();
+		if (config.shaderHotReload)
+		{
+			shaderWatcher.start( std::vector<ShaderSource>( std::begin( HOT_RELOAD_SHADERS ), std::end( HOT_RELOAD_SHADERS ) ) );
+		}
+	}
+
+	void mainLoop()
+	{
+		//0表示不限制帧数（窗口模式下直到关闭窗口）
+		uint64_t frameLimit = 0;
+		if (config.benchmarkFrames > 0)
+		{
+			frameLimit = config.warmupFrames + config.benchmarkFrames;
+			frameTimings.reserve( config.benchmarkFrames );//测量期间不分配内存
+		}
+		else if (config.headless)
+		{
+			frameLimit = config.frameCount > 0 ? config.frameCount : DEFAULT_HEADLESS_FRAMES;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		while (frameLimit == 0 || frameCounter < frameLimit)
+		{
+			if (!config.headless)
+			{
+				if (glfwWindowShouldClose( window ))
+				{
+					break;
+				}
+				glfwPollEvents();
+				inputSampleTime = std::chrono::steady_clock::now();
+			}
+			if (!config.headless && config.resizeInterval > 0 && frameCounter > 0
+				&& frameCounter % config.resizeInterval == 0 && frameCounter != lastResizeFrame)
+			{
+				//在两种大小之间来回切换，模拟用户拖动窗口
+				lastResizeFrame = frameCounter;
+				bool shrink = (frameCounter / config.resizeInterval) % 2 == 1;
+				glfwSetWindowSize( window, shrink ? WIDTH * 3 / 4 : WIDTH, shrink ? HEIGHT * 3 / 4 : HEIGHT );
+			}
+			drawFrame();
+		}
+
+		stopTextureLoading();//加载线程可能还在向传输队列提交
+		vkDeviceWaitIdle( device );
+		double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+		//设备空闲后把还没读取的时间戳全部收回来
+		for (uint32_t i = 0; i < maxFramesInFlight; i++)
+		{
+			collectTimestamps( i );
+		}
+
+		if (frameLimit > 0)
+		{
+			std::cout << frameCounter << " frames in " << seconds * 1000.0 << " ms ("
+				<< frameCounter / seconds << " fps)" << std::endl;
+		}
+
+		if (config.benchmarkFrames > 0)
+		{
+			writeBenchmarkReport();
+		}
+	}
+
+	void writeBenchmarkReport()
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties( physicalDevice, &properties );
+		GpuAllocatorStats memoryStats = allocator.getStats();
+		PipelineManagerStats pipelineStats = pipelineManager.getStats();
+		ShaderWatcherStats shaderStats = shaderWatcher.getStats();
+		DescriptorAllocatorStats descriptorStats = frameDescriptors.getStats();
+
+		ReportInfo info = {
+			{ "device", properties.deviceName },
+			{ "driver_version", std::to_string( properties.driverVersion ) },
+			{ "mode", config.headless ? "headless" : "windowed" },
+			{ "validation", enableValidationLayers ? "on" : "off" },
+			{ "extent", std::to_string( swapChainExtent.width ) + "x" + std::to_string( swapChainExtent.height ) },
+			{ "vertices", std::to_string( mesh.vertices.size() ) },
+			{ "indices", std::to_string( mesh.indices.size() ) },
+			{ "objects", std::to_string( scene.objects.size() ) },
+			{ "draw_mode", drawModeName( config.drawMode ) },
+			{ "camera_zoom", std::to_string( config.cameraZoom ) },
+			{ "draw_indirect_count", drawIndirectCountSupported ? "on" : "off" },
+			{ "record_threads", std::to_string( config.recordThreads ) },
+			{ "upload_ring_region_bytes", std::to_string( uploadRing.getRegionSize() ) },
+			{ "upload_ring_peak_bytes", std::to_string( uploadRing.getHighWater() ) },
+			{ "transfer_queue", asyncUploadsEnabled() ? "dedicated" : "graphics" },
+			{ "compute_queue", asyncComputeEnabled() ? "async" : "graphics" },
+			{ "render_path", config.dynamicRendering ? "dynamic_rendering" : "render_pass" },
+			{ "render_graph_passes", std::to_string( frameGraph.getStats().passCount + computeGraph.getStats().passCount ) },
+			{ "render_graph_culled_passes", std::to_string( frameGraph.getStats().culledPassCount + computeGraph.getStats().culledPassCount ) },
+			{ "render_graph_barriers", std::to_string( frameGraph.getStats().barrierCount + computeGraph.getStats().barrierCount ) },
+			{ "render_graph_transient_bytes", std::to_string( frameGraph.getStats().transientBytes ) },
+			{ "render_graph_transient_unaliased_bytes", std::to_string( frameGraph.getStats().transientBytesUnaliased ) },
+			{ "async_uploads", std::to_string( asyncUploadCount ) },
+			{ "async_upload_bytes", std::to_string( asyncUploadBytes ) },
+			{ "warmup_frames", std::to_string( config.warmupFrames ) },
+			{ "measured_frames", std::to_string( frameTimings.size() ) },
+			{ "pipeline_cache", pipelineCacheWarm ? "warm" : "cold" },
+			{ "pipeline_count", std::to_string( pipelineCount ) },
+			{ "pipeline_variants", std::to_string( pipelineStats.variantCount ) },
+			{ "pipeline_cache_hits", std::to_string( pipelineStats.cacheHits ) },
+			{ "pipeline_requests", std::to_string( pipelineStats.requestCount ) },
+			{ "pipeline_background_compiles", std::to_string( pipelineStats.backgroundCompiles ) },
+			{ "pipeline_background_compile_ms", std::to_string( pipelineStats.backgroundCompileMs ) },
+			{ "pipeline_fallback_frames", std::to_string( pipelineFallbackFrames ) },
+			{ "pipeline_compile", config.asyncPipelineCompile ? "async" : "sync" },
+			{ "object_constants", bindlessEnabled() ? "bindless" : config.objectPushConstants ? "push_constants" : "dynamic_uniform" },
+			{ "descriptor_pools", std::to_string( descriptorStats.poolCount ) },
+			{ "descriptor_sets_allocated", std::to_string( descriptorStats.setsAllocated ) },
+			{ "descriptor_pool_resets", std::to_string( descriptorStats.poolResets ) },
+			{ "asset_archive_entries", std::to_string( assetArchive.getEntryCount() ) },
+			{ "asset_archive_hits", std::to_string( assetArchiveHits.load() ) },
+			{ "asset_file_maps", std::to_string( assetFileMaps.load() ) },
+			{ "textures_loaded", std::to_string( texturesLoaded ) },
+			{ "texture_load_failures", std::to_string( textureLoadFailures.load() ) },
+			{ "texture_upload_bytes", std::to_string( textureUploadBytes ) },
+			{ "texture_placeholder_frames", std::to_string( texturePlaceholderFrames ) },
+			{ "texture_format", textureFormatName( textureFormat ) },
+			{ "texture_compressed_formats", std::to_string( compressedFormats.size() ) },
+			{ "texture_cpu_fallbacks", std::to_string( textureCpuFallbacks ) },
+			{ "texture_gpu_bytes", std::to_string( textureGpuBytes ) },
+			{ "texture_rgba8_bytes", std::to_string( textureRgba8Bytes ) },
+			{ "texture_memory_saved_bytes", std::to_string( textureRgba8Bytes > textureGpuBytes ? textureRgba8Bytes - textureGpuBytes : 0 ) },
+			{ "texture_decode_ms", std::to_string( textureDecodeMs ) },
+			{ "texture_upload_ms", std::to_string( textureUploadMs ) },
+			{ "bindless_buffers", std::to_string( bindlessBufferCount ) },
+			{ "bindless_textures", std::to_string( bindlessTextureCount ) },
+			{ "pipeline_reloads", std::to_string( pipelineStats.reloads ) },
+			{ "shader_reloads", std::to_string( shaderStats.compiles ) },
+			{ "shader_reload_failures", std::to_string( shaderStats.failures ) },
+			{ "shader_compile_ms", std::to_string( shaderStats.compileMs ) },
+			{ "blend_mode", blendModeName( config.blendMode ) },
+			{ "cull_mode", config.cullMode == VK_CULL_MODE_NONE ? "none" : "back" },
+			{ "pipeline_creation_ms", std::to_string( pipelineCreationMs ) },
+			{ "time_to_first_frame_ms", std::to_string( timeToFirstFrameMs ) },
+			{ "swapchain_recreations", std::to_string( swapChainRecreateMs.size() ) },
+			{ "resize_mode", config.resizeWaitIdle ? "wait_idle" : "deferred" },
+			{ "sync_mode", config.syncMode == SyncMode::Timeline ? "timeline" : "fence" },
+			{ "frames_in_flight", std::to_string( maxFramesInFlight ) },
+			{ "pacing", framePacingName( config.pacing ) },
+			{ "present_mode", config.headless ? "none" : presentModeName( swapChainPresentMode ) },
+			{ "swapchain_images", std::to_string( swapChainImages.size() ) },
+			{ "gpu_memory_blocks", std::to_string( memoryStats.blockCount ) },
+			{ "gpu_memory_allocations", std::to_string( memoryStats.allocationCount ) },
+			{ "gpu_memory_reserved_bytes", std::to_string( memoryStats.bytesReserved ) },
+			{ "gpu_memory_used_bytes", std::to_string( memoryStats.bytesUsed ) },
+			{ "gpu_memory_fragmentation", std::to_string( memoryStats.fragmentation ) }
+		};
+
+		//按阶段拆成独立的样本序列
+		std::vector<std::pair<std::string, double FrameTimings::*>> fields = {
+			{ "fence_wait_ms", &FrameTimings::fenceWait },
+			{ "acquire_ms", &FrameTimings::acquire },
+			{ "record_ms", &FrameTimings::record },
+			{ "submit_ms", &FrameTimings::submit },
+			{ "present_ms", &FrameTimings::present },
+			{ "frame_ms", &FrameTimings::total }
+		};
+		if (!config.headless)
+		{
+			fields.push_back( { "input_to_present_ms", &FrameTimings::inputToPresent } );
+		}
+		if (timestampsSupported)
+		{
+			fields.push_back( { "gpu_render_pass_ms", &FrameTimings::gpuRenderPass } );
+			fields.push_back( { "gpu_draw_ms", &FrameTimings::gpuDraw } );
+			if (config.drawMode == DrawMode::Indirect)
+			{
+				fields.push_back( { "gpu_cull_ms", &FrameTimings::gpuCull } );
+			}
+		}
+
+		ReportMetrics metrics;
+		for (const auto& [name, field] : fields)
+		{
+			std::vector<double> samples;
+			samples.reserve( frameTimings.size() );
+			for (const FrameTimings& timings : frameTimings)
+			{
+				samples.push_back( timings.*field );
+			}
+			metrics.emplace_back( name, computeTimingStats( samples ) );
+		}
+		if (!swapChainRecreateMs.empty())
+		{
+			metrics.emplace_back( "swapchain_recreate_ms", computeTimingStats( swapChainRecreateMs ) );
+		}
+
+		std::ofstream file( config.reportPath );
+		if (!file.is_open())
+		{
+			throw std::runtime_error( "failed to open benchmark report file!" );
+		}
+		bool csv = config.reportPath.size() >= 4 && config.reportPath.compare( config.reportPath.size() - 4, 4, ".csv" ) == 0;
+		if (csv)
+		{
+			writeReportCsv( file, info, metrics );
+		}
+		else
+		{
+			writeReportJson( file, info, metrics );
+		}
+
+		writeReportCsv( std::cout, info, metrics );
+		std::cout << "benchmark report written to " << config.reportPath << std::endl;
+	}
+
+	void cleanupSwapChain()
+	{
+		for (auto framebuffer : swapChainFramebuffers)
+		{
+			vkDestroyFramebuffer( device, framebuffer, nullptr );
+		}
+
+		for (auto imageView : swapChainImageViews)
+		{
+			vkDestroyImageView( device, imageView, nullptr );
+		}
+
+		if (config.headless)
+		{
+			for (size_t i = 0; i < swapChainImages.size(); i++)
+			{
+				vkDestroyImage( device, swapChainImages[i], nullptr );
+				allocator.free( offscreenImageMemory[i] );
+			}
+			return;
+		}
+
+		vkDestroySwapchainKHR( device, swapChain, nullptr );
+	}
+
+	//frameCounter帧开始时已经等待过它所在槽位的栅栏，frameCounter - maxFramesInFlight及之前的帧都已完成。
+	//时间线模式直接读取计数器，GPU跑得快时能更早回收
+	void flushDeletionQueue()
+	{
+		if (config.syncMode == SyncMode::Timeline)
+		{
+			uint64_t completedValue = 0;
+			vkGetSemaphoreCounterValue( device, graphicsTimeline, &completedValue );
+			if (completedValue > 0)
+			{
+				deletionQueue.flush( completedValue - 1 );
+			}
+			return;
+		}
+
+		if (frameCounter >= maxFramesInFlight)
+		{
+			deletionQueue.flush( frameCounter - maxFramesInFlight );
+		}
+	}
+
+	//以下函数把资源交给deletionQueue，当前帧（frameCounter）是最后一个可能用到它的帧
+	void retireImage( VkImage image, GpuAllocation allocation )
+	{
+		deletionQueue.push( frameCounter, [this, image, allocation]() mutable
+			{
+				vkDestroyImage( device, image, nullptr );
+				allocator.free( allocation );
+			} );
+	}
+
+	void retireImageView( VkImageView imageView )
+	{
+		deletionQueue.push( frameCounter, [this, imageView]() { vkDestroyImageView( device, imageView, nullptr ); } );
+	}
+
+	void retireFramebuffer( VkFramebuffer framebuffer )
+	{
+		deletionQueue.push( frameCounter, [this, framebuffer]() { vkDestroyFramebuffer( device, framebuffer, nullptr ); } );
+	}
+
+	void retirePipeline( VkPipeline pipeline )
+	{
+		deletionQueue.push( frameCounter, [this, pipeline]() { vkDestroyPipeline( device, pipeline, nullptr ); } );
+	}
+
+	//渲染图的临时图像可能仍被飞行中的帧使用，和其他资源一样交给deletionQueue
+	void destroyRenderGraphs()
+	{
+		auto destroyImage = [this]( VkImage image, VkImageView imageView )
+			{
+				retireImageView( imageView );
+				retireImage( image, GpuAllocation{} );//内存可能被别名共享，由freeMemory单独释放
+			};
+		auto freeMemory = [this]( GpuAllocation& memory )
+			{
+				deletionQueue.push( frameCounter, [this, memory]() mutable { allocator.free( memory ); } );
+			};
+		frameGraph.destroy( destroyImage, freeMemory );
+		computeGraph.destroy( destroyImage, freeMemory );
+	}
+
+	//旧交换链作为oldSwapchain传给新交换链后不能再获取图像，但已提交的呈现可能还在使用它
+	void retireSwapChain()
+	{
+		for (auto framebuffer : swapChainFramebuffers)
+		{
+			retireFramebuffer( framebuffer );
+		}
+		for (auto imageView : swapChainImageViews)
+		{
+			retireImageView( imageView );
+		}
+		retiredSwapChains.push_back( swapChain );
+		retireMarkerImage.reset();//之前记下的图像属于旧交换链，在新交换链上重新记录
+	}
+
+	//本帧等待imageAvailable信号量，栅栏发出信号时呈现引擎也已经释放了图像，旧交换链交给deletionQueue
+	void releaseRetiredSwapChains( uint32_t acquiredImage )
+	{
+		if (!retireMarkerImage || *retireMarkerImage != acquiredImage)
+		{
+			return;
+		}
+		for (VkSwapchainKHR oldSwapChain : retiredSwapChains)
+		{
+			deletionQueue.push( frameCounter, [this, oldSwapChain]() { vkDestroySwapchainKHR( device, oldSwapChain, nullptr ); } );
+		}
+		retiredSwapChains.clear();
+		retireMarkerImage.reset();
+	}
+
+	void cleanup()
+	{
+		destroyRenderGraphs();
+		deletionQueue.flushAll();//mainLoop结束时设备已经空闲
+		for (VkSwapchainKHR oldSwapChain : retiredSwapChains)
+		{
+			vkDestroySwapchainKHR( device, oldSwapChain, nullptr );
+		}
+		retiredSwapChains.clear();
+		cleanupSwapChain();
+
+		shaderWatcher.stop();
+		pipelineManager.stop();
+		pipelineManager.destroy( device );//包括graphicsPipeline
+		vkDestroyPipelineLayout( device, pipelineLayout, nullptr );
+
+		if (config.drawMode == DrawMode::Indirect)
+		{
+			vkDestroyPipeline( device, cullPipeline, nullptr );
+			vkDestroyPipelineLayout( device, cullPipelineLayout, nullptr );
+			vkDestroyDescriptorSetLayout( device, cullDescriptorSetLayout, nullptr );
+		}
+
+		frameDescriptors.destroy();
+		vkDestroyDescriptorSetLayout( device, descriptorSetLayout, nullptr );
+		destroyTextures();
+		if (bindlessEnabled())
+		{
+			vkDestroyDescriptorPool( device, bindlessPool, nullptr );
+			vkDestroyDescriptorSetLayout( device, bindlessSetLayout, nullptr );
+		}
+
+		savePipelineCache();
+		vkDestroyPipelineCache( device, pipelineCache, nullptr );
+
+		vkDestroyRenderPass( device, renderPass, nullptr );
+
+		if (config.drawMode == DrawMode::Indirect)
+		{
+			vkDestroyBuffer( device, drawCommandBuffer, nullptr );
+			allocator.free( drawCommandBufferMemory );
+		}
+
+		vkDestroyBuffer( device, uploadRingBuffer, nullptr );
+		allocator.free( uploadRingMemory );
+
+		vkDestroyBuffer( device, indexBuffer, nullptr );
+		allocator.free( indexBufferMemory );
+
+		vkDestroyBuffer( device, vertexBuffer, nullptr );
+		allocator.free( vertexBufferMemory );
+
+		for (size_t i = 0; i < maxFramesInFlight; i++)
+		{
+			vkDestroySemaphore( device, renderFinishedSemaphores[i], nullptr );
+			vkDestroySemaphore( device, imageAvailableSemaphores[i], nullptr );
+			vkDestroyFence( device, inFlightFences[i], nullptr );
+		}
+		vkDestroySemaphore( device, graphicsTimeline, nullptr );
+
+		if (timestampQueryPool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool( device, timestampQueryPool, nullptr );
+		}
+
+		recordWorkers.stop();
+		for (VkCommandPool pool : workerCommandPools)
+		{
+			vkDestroyCommandPool( device, pool, nullptr );
+		}
+		vkDestroyCommandPool( device, commandPool, nullptr );
+
+		//从未被图形帧获取的上传（还没开始渲染就退出）
+		for (PendingAcquire& acquire : pendingAcquires)
+		{
+			acquire.release();
+		}
+		pendingAcquires.clear();
+		vkDestroyCommandPool( device, transferCommandPool, nullptr );
+		vkDestroySemaphore( device, transferTimeline, nullptr );
+		vkDestroyCommandPool( device, computeCommandPool, nullptr );
+		vkDestroySemaphore( device, computeTimeline, nullptr );
+
+		allocator.destroy();
+		vkDestroyDevice( device, nullptr );
+
+		if (enableValidationLayers)
+		{
+			DestroyDebugUtilsMessengerEXT( instance, debugMessenger, nullptr );
+		}
+
+		if (!config.headless)
+		{
+			vkDestroySurfaceKHR( instance, surface, nullptr );
+		}
+		vkDestroyInstance( instance, nullptr );
+
+		if (!config.headless)
+		{
+			glfwDestroyWindow( window );
+
+			glfwTerminate();
+		}
+	}
+
+	void recreateSwapChain()
+	{
+		int width = 0, height = 0;
+		glfwGetFramebufferSize( window, &width, &height );
+		while (width == 0 || height == 0)
+		{
+			glfwGetFramebufferSize( window, &width, &height );
+			glfwWaitEvents();//阻塞，直到事件队列中有新的事件
+		}
+
+		auto recreateStart = std::chrono::steady_clock::now();
+
+		if (config.resizeWaitIdle)
+		{
+			vkDeviceWaitIdle( device );//排空整个GPU，调整窗口时明显卡顿
+			cleanupSwapChain();
+			swapChain = VK_NULL_HANDLE;
+		}
+		else
+		{
+			//还在飞行中的帧仍然引用旧的帧缓冲，推迟到它们的栅栏发出信号后再销毁
+			retireSwapChain();
+		}
+
+		createSwapChain();//旧交换链通过oldSwapchain传入，驱动可以复用它的资源
+		createImageViews();
+		createFramebuffers();
+
+		//临时图像的大小跟随交换链
+		destroyRenderGraphs();
+		buildRenderGraphs();
+
+		swapChainRecreateMs.push_back( std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - recreateStart ).count() );
+	}
+
+	void createInstance()
+	{
+		// 检查验证层是否有效
+		if (enableValidationLayers && !checkValidationLayerSupport())
+		{
+			throw std::runtime_error( "validation layers requested, but not available!" );
+		}
+		// 填写appInfo和instanceInfo结构体
+		VkApplicationInfo appInfo{};
+		appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+		appInfo.pApplicationName = "Hello Triangle";
+		appInfo.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+		appInfo.pEngineName = "No Engine";
+		appInfo.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+		appInfo.apiVersion = VK_API_VERSION_1_3;//设备支持时使用drawIndirectCount等1.2特性和1.3的动态渲染
+
+		VkInstanceCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+		createInfo.pApplicationInfo = &appInfo;
+		// 获取扩展
+		auto extensions = getRequiredExtensions();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		createInfo.ppEnabledExtensionNames = extensions.data();
+
+		// 为instance创建和销毁过程创建单独的debug messenger
+		VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+		if (enableValidationLayers)
+		{
+			createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());//only one validation layer
+			createInfo.ppEnabledLayerNames = validationLayers.data();
+
+			populateDebugMessengerCreateInfo( debugCreateInfo );
+			// 通过将指向 VkDebugUtilsMessengerCreateInfoEXT 结构的指针传递到 VkInstanceCreateInfo 的 pNext 扩展字段中，
+			// 为 vkCreateInstance 和 vkDestroyInstance 提供专门的调试支持
+			createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+		}
+		else
+		{
+			createInfo.enabledLayerCount = 0;
+
+			createInfo.pNext = nullptr;
+		}
+		// 创建Vulkan实例
+		if (vkCreateInstance( &createInfo, nullptr, &instance ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create instance!" );
+		}
+	}
+
+	void populateDebugMessengerCreateInfo( VkDebugUtilsMessengerCreateInfoEXT& createInfo )
+	{
+		createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+		createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+		createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		createInfo.pfnUserCallback = debugCallback;
+	}
+
+	void setupDebugMessenger()
+	{
+		if (!enableValidationLayers)
+			return;
+		// 填写debug messenger create info
+		VkDebugUtilsMessengerCreateInfoEXT createInfo;
+		populateDebugMessengerCreateInfo( createInfo );
+		// 创建debug messenger
+		if (CreateDebugUtilsMessengerEXT( instance, &createInfo, nullptr, &debugMessenger ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to set up debug messenger!" );
+		}
+	}
+
+	void createSurface()
+	{
+		if (config.headless)
+			return;
+
+		if (glfwCreateWindowSurface( instance, window, nullptr, &surface ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create window surface!" );
+		}
+	}
+
+	void pickPhysicalDevice()
+	{
+		// get available device number
+		uint32_t deviceCount = 0;
+		vkEnumeratePhysicalDevices( instance, &deviceCount, nullptr );
+
+		if (deviceCount == 0)
+		{
+			throw std::runtime_error( "failed to find GPUs with Vulkan support!" );
+		}
+		// get available devices
+		std::vector<VkPhysicalDevice> devices( deviceCount );
+		vkEnumeratePhysicalDevices( instance, &deviceCount, devices.data() );
+		// check if device suitable
+		for (const auto& device : devices)
+		{
+			if (isDeviceSuitable( device ))
+			{
+				physicalDevice = device;
+				break;
+			}
+		}
+
+		if (physicalDevice == VK_NULL_HANDLE)
+		{
+			throw std::runtime_error( "failed to find a suitable GPU!" );
+		}
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties( physicalDevice, &properties );
+		std::cout << "using device: " << properties.deviceName << std::endl;
+
+		queryCompressedFormats( properties );
+	}
+
+	//软件实现（lavapipe、SwiftShader）即使报告支持，采样压缩格式也是逐像素解码，不如上传前解码一次
+	void queryCompressedFormats( const VkPhysicalDeviceProperties& properties )
+	{
+		compressedFormats.clear();
+		if (!config.compressedTextures || properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
+		{
+			textureCompressionBC = textureCompressionETC2 = textureCompressionASTC = false;
+			return;
+		}
+
+		VkPhysicalDeviceFeatures features;
+		vkGetPhysicalDeviceFeatures( physicalDevice, &features );
+		textureCompressionBC = features.textureCompressionBC;
+		textureCompressionETC2 = features.textureCompressionETC2;
+		textureCompressionASTC = features.textureCompressionASTC_LDR;
+
+		const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+		for (int f = VK_FORMAT_BC1_RGB_UNORM_BLOCK; f <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK; f++)
+		{
+			VkFormat format = static_cast<VkFormat>(f);
+			bool enabled = f <= VK_FORMAT_BC7_SRGB_BLOCK ? textureCompressionBC :
+				f <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK ? textureCompressionETC2 : textureCompressionASTC;
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties( physicalDevice, format, &formatProperties );
+			if (enabled && (formatProperties.optimalTilingFeatures & required) == required)
+			{
+				compressedFormats.insert( format );
+			}
+		}
+	}
+
+	void createLogicalDevice()
+	{
+		// 查找并筛选物理设备支持的队列族中哪些支持指定的特性
+		QueueFamilyIndices indices = findQueueFamilies( physicalDevice );
+
+		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+		std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value() };
+		if (indices.presentFamily.has_value())
+		{
+			uniqueQueueFamilies.insert( indices.presentFamily.value() );
+		}
+		if (indices.transferFamily.has_value())
+		{
+			uniqueQueueFamilies.insert( indices.transferFamily.value() );
+		}
+		if (indices.computeFamily.has_value())
+		{
+			uniqueQueueFamilies.insert( indices.computeFamily.value() );
+		}
+
+		float queuePriority = 1.0f;
+		//populate queueCreateInfo for all queueFamilies.
+		for (uint32_t queueFamily : uniqueQueueFamilies)
+		{
+			VkDeviceQueueCreateInfo queueCreateInfo{};
+			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueCreateInfo.queueFamilyIndex = queueFamily;
+			queueCreateInfo.queueCount = 1;
+			queueCreateInfo.pQueuePriorities = &queuePriority;
+			queueCreateInfos.push_back( queueCreateInfo );
+		}
+
+		queryDeviceFeatures();
+		if (config.drawMode == DrawMode::Indirect && !multiDrawIndirectSupported)
+		{
+			throw std::runtime_error( "indirect draw mode requires the multiDrawIndirect feature!" );
+		}
+		if (config.syncMode == SyncMode::Timeline && !timelineSemaphoreSupported)
+		{
+			throw std::runtime_error( "timeline sync mode requires Vulkan 1.2 timeline semaphores!" );
+		}
+		if (config.dynamicRendering && !dynamicRenderingSupported)
+		{
+			throw std::runtime_error( "dynamic rendering requires Vulkan 1.3!" );
+		}
+		if (bindlessEnabled() && !bindlessSupported)
+		{
+			throw std::runtime_error( "bindless mode requires descriptor indexing!" );
+		}
+
+		VkPhysicalDeviceVulkan13Features vulkan13Features{};
+		vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+		vulkan13Features.dynamicRendering = config.dynamicRendering;
+
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		vulkan12Features.pNext = deviceApiVersion >= VK_API_VERSION_1_3 ? &vulkan13Features : nullptr;
+		vulkan12Features.drawIndirectCount = drawIndirectCountSupported;
+		vulkan12Features.timelineSemaphore = timelineSemaphoreSupported;
+		vulkan12Features.runtimeDescriptorArray = bindlessEnabled();
+		vulkan12Features.descriptorBindingPartiallyBound = bindlessEnabled();
+		vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = bindlessEnabled();
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = bindlessEnabled();
+
+		VkPhysicalDeviceFeatures2 deviceFeatures{};
+		deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		deviceFeatures.pNext = deviceApiVersion >= VK_API_VERSION_1_2 ? &vulkan12Features : nullptr;
+		deviceFeatures.features.multiDrawIndirect = multiDrawIndirectSupported;
+		deviceFeatures.features.textureCompressionBC = textureCompressionBC;
+		deviceFeatures.features.textureCompressionETC2 = textureCompressionETC2;
+		deviceFeatures.features.textureCompressionASTC_LDR = textureCompressionASTC;
+		deviceFeatures.features.shaderStorageBufferArrayDynamicIndexing = bindlessEnabled();//buffers[draw.objectBuffer]
+		deviceFeatures.features.shaderSampledImageArrayDynamicIndexing = bindlessEnabled();//textures[draw.texture]
+		//populate logical device create info
+		VkDeviceCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+
+		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+		createInfo.pQueueCreateInfos = queueCreateInfos.data();
+
+		//1.0设备不认识VkPhysicalDeviceFeatures2，只能用pEnabledFeatures
+		if (deviceApiVersion >= VK_API_VERSION_1_1)
+		{
+			createInfo.pNext = &deviceFeatures;
+		}
+		else
+		{
+			createInfo.pEnabledFeatures = &deviceFeatures.features;
+		}
+
+		auto extensions = getRequiredDeviceExtensions();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		createInfo.ppEnabledExtensionNames = extensions.data();
+		//create logical device
+		if (vkCreateDevice( physicalDevice, &createInfo, nullptr, &device ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create logical device!" );
+		}
+		//获得队列句柄
+		vkGetDeviceQueue( device, indices.graphicsFamily.value(), 0, &graphicsQueue );
+		if (indices.presentFamily.has_value())
+		{
+			vkGetDeviceQueue( device, indices.presentFamily.value(), 0, &presentQueue );
+		}
+		if (indices.transferFamily.has_value())
+		{
+			vkGetDeviceQueue( device, indices.transferFamily.value(), 0, &transferQueue );
+		}
+		if (indices.computeFamily.has_value())
+		{
+			vkGetDeviceQueue( device, indices.computeFamily.value(), 0, &computeQueue );
+		}
+	}
+
+	//记录设备支持的可选特性，createLogicalDevice只启用支持的那些
+	void queryDeviceFeatures()
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties( physicalDevice, &properties );
+		deviceApiVersion = properties.apiVersion;
+
+		if (deviceApiVersion < VK_API_VERSION_1_1)
+		{
+			VkPhysicalDeviceFeatures features;
+			vkGetPhysicalDeviceFeatures( physicalDevice, &features );
+			multiDrawIndirectSupported = features.multiDrawIndirect;
+			return;
+		}
+
+		VkPhysicalDeviceVulkan13Features vulkan13Features{};
+		vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		vulkan12Features.pNext = deviceApiVersion >= VK_API_VERSION_1_3 ? &vulkan13Features : nullptr;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = deviceApiVersion >= VK_API_VERSION_1_2 ? &vulkan12Features : nullptr;
+		vkGetPhysicalDeviceFeatures2( physicalDevice, &features );
+
+		multiDrawIndirectSupported = features.features.multiDrawIndirect;
+		drawIndirectCountSupported = deviceApiVersion >= VK_API_VERSION_1_2 && vulkan12Features.drawIndirectCount;
+		timelineSemaphoreSupported = deviceApiVersion >= VK_API_VERSION_1_2 && vulkan12Features.timelineSemaphore;
+		dynamicRenderingSupported = deviceApiVersion >= VK_API_VERSION_1_3 && vulkan13Features.dynamicRendering;
+		bindlessSupported = deviceApiVersion >= VK_API_VERSION_1_2 && vulkan12Features.runtimeDescriptorArray && vulkan12Features.descriptorBindingPartiallyBound &&
+			vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind && vulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+			features.features.shaderStorageBufferArrayDynamicIndexing && features.features.shaderSampledImageArrayDynamicIndexing;
+	}
+
+	//bindless只用于逐对象绘制，实例化和间接绘制的每实例数据本来就不需要逐次绑定
+	bool bindlessEnabled() const
+	{
+		return config.bindless && config.drawMode == DrawMode::PerObject;
+	}
+
+	//从磁盘加载管线缓存。缓存头中的vendorID/deviceID/pipelineCacheUUID与当前设备不一致
+	//（换了显卡或驱动）或者文件损坏时，丢弃旧数据，从空缓存开始
+	void createPipelineCache()
+	{
+		std::vector<char> cacheData;
+		if (!config.pipelineCachePath.empty() && std::filesystem::exists( config.pipelineCachePath ))
+		{
+			cacheData = readFile( config.pipelineCachePath );
+			if (!isPipelineCacheCompatible( cacheData ))
+			{
+				std::cout << "pipeline cache " << config.pipelineCachePath << " is stale or corrupt, ignoring it" << std::endl;
+				cacheData.clear();
+			}
+		}
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = cacheData.size();
+		cacheInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+		VkResult result = vkCreatePipelineCache( device, &cacheInfo, nullptr, &pipelineCache );
+		if (result != VK_SUCCESS && !cacheData.empty())
+		{
+			//驱动仍然拒绝了数据，退回到空缓存
+			cacheInfo.initialDataSize = 0;
+			cacheInfo.pInitialData = nullptr;
+			cacheData.clear();
+			result = vkCreatePipelineCache( device, &cacheInfo, nullptr, &pipelineCache );
+		}
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create pipeline cache!" );
+		}
+
+		pipelineCacheWarm = !cacheData.empty();
+	}
+
+	bool isPipelineCacheCompatible( const std::vector<char>& cacheData )
+	{
+		VkPipelineCacheHeaderVersionOne header;
+		if (cacheData.size() < sizeof( header ))
+		{
+			return false;
+		}
+		memcpy( &header, cacheData.data(), sizeof( header ) );
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties( physicalDevice, &properties );
+
+		return header.headerSize >= sizeof( header ) && header.headerSize <= cacheData.size() &&
+			header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			header.vendorID == properties.vendorID &&
+			header.deviceID == properties.deviceID &&
+			memcmp( header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE ) == 0;
+	}
+
+	//先写临时文件再替换，程序中途退出也不会留下半个缓存文件
+	void savePipelineCache()
+	{
+		if (config.pipelineCachePath.empty())
+		{
+			return;
+		}
+
+		size_t dataSize = 0;
+		if (vkGetPipelineCacheData( device, pipelineCache, &dataSize, nullptr ) != VK_SUCCESS || dataSize == 0)
+		{
+			return;
+		}
+		std::vector<char> data( dataSize );
+		if (vkGetPipelineCacheData( device, pipelineCache, &dataSize, data.data() ) != VK_SUCCESS)
+		{
+			return;
+		}
+
+		std::string tempPath = config.pipelineCachePath + ".tmp";
+		{
+			std::ofstream file( tempPath, std::ios::binary | std::ios::trunc );
+			if (!file.is_open())
+			{
+				std::cerr << "failed to write pipeline cache " << tempPath << std::endl;
+				return;
+			}
+			file.write( data.data(), dataSize );
+		}
+
+		std::error_code error;
+		std::filesystem::rename( tempPath, config.pipelineCachePath, error );
+		if (error)
+		{
+			std::cerr << "failed to save pipeline cache: " << error.message() << std::endl;
+		}
+	}
+
+	void createSwapChain()
+	{
+		if (config.headless)
+		{
+			createOffscreenTargets();
+			return;
+		}
+
+		//get swapChain support details
+		SwapChainSupportDetails swapChainSupport = querySwapChainSupport( physicalDevice );
+
+		//choose the specified(the best) stuff
+		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat( swapChainSupport.formats );
+		VkPresentModeKHR presentMode = chooseSwapPresentMode( swapChainSupport.presentModes );
+		VkExtent2D extent = chooseSwapExtent( swapChainSupport.capabilities );
+
+		//imageCount, i.e. buffer count in swapChain
+		uint32_t imageCount = swapChainSupport.capabilities.minImageCount + pacingPolicy.extraSwapChainImages;
+		//限制imagecount小于最大imagecount
+		//capabilities.maxImageCount==0时表示没有最大限制
+		if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
+		{
+			imageCount = swapChainSupport.capabilities.maxImageCount;
+		}
+
+		VkSwapchainCreateInfoKHR createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+		createInfo.surface = surface;
+		//最终的image count由VULKAN驱动决定，程序员只需要限制image count的范围
+		createInfo.minImageCount = imageCount;
+		createInfo.imageFormat = surfaceFormat.format;
+		createInfo.imageColorSpace = surfaceFormat.colorSpace;
+		createInfo.imageExtent = extent;
+		createInfo.imageArrayLayers = 1;
+		createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+		QueueFamilyIndices indices = findQueueFamilies( physicalDevice );
+		uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+
+		if (indices.graphicsFamily != indices.presentFamily)
+		{
+			createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+			createInfo.queueFamilyIndexCount = 2;
+			createInfo.pQueueFamilyIndices = queueFamilyIndices;//指定数组内两个队列族共享所有权
+		}
+		else
+		{
+			createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		}
+
+		createInfo.preTransform = swapChainSupport.capabilities.currentTransform;//交换链中图像变换
+		createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+		createInfo.presentMode = presentMode;
+		createInfo.clipped = VK_TRUE;
+
+		createInfo.oldSwapchain = swapChain;//首次创建时为VK_NULL_HANDLE，之后旧交换链被废弃，只能再用于呈现已获取的图像
+
+		if (vkCreateSwapchainKHR( device, &createInfo, nullptr, &swapChain ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create swap chain!" );
+		}
+		//get swap chain image count
+		vkGetSwapchainImagesKHR( device, swapChain, &imageCount, nullptr );
+		swapChainImages.resize( imageCount );
+		//get swap chain image handle
+		vkGetSwapchainImagesKHR( device, swapChain, &imageCount, swapChainImages.data() );
+
+		swapChainImageFormat = surfaceFormat.format;
+		swapChainExtent = extent;
+		swapChainPresentMode = presentMode;
+	}
+
+	//headless模式：用device local的VkImage代替交换链图像，每个飞行中的帧一张，
+	//之后的image view、framebuffer和录制命令都与窗口模式走同一条路径
+	void createOffscreenTargets()
+	{
+		swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		swapChainExtent = { WIDTH, HEIGHT };
+
+		swapChainImages.resize( maxFramesInFlight );
+		offscreenImageMemory.resize( maxFramesInFlight );
+
+		for (size_t i = 0; i < swapChainImages.size(); i++)
+		{
+			//TRANSFER_SRC便于回读结果
+			createImage( swapChainExtent.width, swapChainExtent.height, swapChainImageFormat,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, swapChainImages[i], offscreenImageMemory[i] );
+		}
+	}
+
+	void createImage( uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImage& image, GpuAllocation& imageMemory,
+		uint32_t mipLevels = 1 )
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = format;
+		imageInfo.extent = { width, height, 1 };
+		imageInfo.mipLevels = mipLevels;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage( device, &imageInfo, nullptr, &image ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create image!" );
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements( device, image, &memRequirements );
+
+		imageMemory = allocator.allocate( memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GpuResourceKind::Image );
+		vkBindImageMemory( device, image, imageMemory.memory, imageMemory.offset );
+	}
+
+	void createImageViews()
+	{
+		//调整视图数量等于交换链图像数量
+		swapChainImageViews.resize( swapChainImages.size() );
+		//遍历所有交换链图像，填写create info
+		for (size_t i = 0; i < swapChainImages.size(); i++)
+		{
+			VkImageViewCreateInfo createInfo{};
+			createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			createInfo.image = swapChainImages[i];
+			createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			createInfo.format = swapChainImageFormat;
+			createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+			createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+			createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+			createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+			createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			createInfo.subresourceRange.baseMipLevel = 0;
+			createInfo.subresourceRange.levelCount = 1;
+			createInfo.subresourceRange.baseArrayLayer = 0;
+			createInfo.subresourceRange.layerCount = 1;
+
+			if (vkCreateImageView( device, &createInfo, nullptr, &swapChainImageViews[i] ) != VK_SUCCESS)
+			{
+				throw std::runtime_error( "failed to create image views!" );
+			}
+		}
+	}
+
+	void createRenderPass()
+	{
+		if (config.dynamicRendering)
+		{
+			return;//附件在vkCmdBeginRendering时直接指定
+		}
+
+		//缓冲区附件
+		VkAttachmentDescription colorAttachment{};
+		colorAttachment.format = swapChainImageFormat;
+		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		//指定颜色和深度数据该如何处理
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;//渲染前
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;//渲染后
+		//指定模板数据该如何处理
+		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;//渲染前
+		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;//渲染后
+		//指定内存中像素布局；进入和离开渲染通道的布局转换和同步由渲染图的屏障完成
+		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;//渲染前
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;//渲染后
+
+		VkAttachmentReference colorAttachmentRef{};
+		colorAttachmentRef.attachment = 0;//引用attachment discription
+		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;//附件在使用此引用的子过程期间具有的布局
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorAttachmentRef; //此数组中附件的索引直接从片段着色器使用 layout( location = 0 ) out vec4 outColor 指令引用！
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = 1;
+		renderPassInfo.pAttachments = &colorAttachment;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+
+		if (vkCreateRenderPass( device, &renderPassInfo, nullptr, &renderPass ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create render pass!" );
+		}
+	}
+
+	void createDescriptorSetLayout()
+	{
+		std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+		//binding 0: FrameConstants，binding 1: ObjectConstants，binding 2: 材质纹理
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;//偏移在绑定时指定
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		}
+		bindings[2].binding = 2;
+		bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[2].descriptorCount = 1;
+		bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout( device, &layoutInfo, nullptr, &descriptorSetLayout ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create descriptor set layout!" );
+		}
+
+		if (!bindlessEnabled())
+		{
+			return;
+		}
+
+		//set 1，binding 0: 缓冲区数组，binding 1: 纹理数组。只写入用到的元素，集合绑定后仍可写入新元素
+		std::array<VkDescriptorSetLayoutBinding, 2> bindlessBindings{};
+		bindlessBindings[0].binding = 0;
+		bindlessBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindlessBindings[0].descriptorCount = BINDLESS_MAX_BUFFERS;
+		bindlessBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		bindlessBindings[1].binding = 1;
+		bindlessBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindlessBindings[1].descriptorCount = BINDLESS_MAX_TEXTURES;
+		bindlessBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		std::array<VkDescriptorBindingFlags, 2> bindingFlags{};
+		bindingFlags.fill( VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT );
+		VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+		bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+		bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+		VkDescriptorSetLayoutCreateInfo bindlessLayoutInfo{};
+		bindlessLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		bindlessLayoutInfo.pNext = &bindingFlagsInfo;
+		bindlessLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		bindlessLayoutInfo.bindingCount = static_cast<uint32_t>(bindlessBindings.size());
+		bindlessLayoutInfo.pBindings = bindlessBindings.data();
+
+		if (vkCreateDescriptorSetLayout( device, &bindlessLayoutInfo, nullptr, &bindlessSetLayout ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create bindless descriptor set layout!" );
+		}
+	}
+
+	void createGraphicsPipeline()
+	{
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		VkDescriptorSetLayout setLayouts[] = { descriptorSetLayout, bindlessSetLayout };
+		pipelineLayoutInfo.setLayoutCount = bindlessEnabled() ? 2 : 1;
+		pipelineLayoutInfo.pSetLayouts = setLayouts;
+		//逐次绘制的参数，128字节以内所有设备都支持。bindless模式下片元着色器读取其中的纹理下标
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = bindlessEnabled() ? VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT : VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof( ObjectConstants );
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout( device, &pipelineLayoutInfo, nullptr, &pipelineLayout ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create pipeline layout!" );
+		}
+
+		pipelineManager.start( [this]( const GraphicsPipelineDesc& desc ) { return buildGraphicsPipeline( desc ); }, PIPELINE_COMPILE_THREADS );
+
+		//基础变体同步编译，之后的变体由后台线程编译
+		auto pipelineStart = std::chrono::steady_clock::now();
+		graphicsPipeline = pipelineManager.get( makePipelineDesc( BlendMode::Opaque, VK_CULL_MODE_BACK_BIT ) );
+		pipelineCreationMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - pipelineStart ).count();
+		pipelineCount++;
+		activePipeline = graphicsPipeline;
+	}
+
+	GraphicsPipelineDesc makePipelineDesc( BlendMode blend, VkCullModeFlags cullMode ) const
+	{
+		GraphicsPipelineDesc desc;
+		desc.instanced = config.drawMode != DrawMode::PerObject;//间接绘制同样从第二个顶点绑定读取每实例数据
+		desc.vertexShader = desc.instanced ? "shaders/instanced_vert.spv" : bindlessEnabled() ? "shaders/bindless_vert.spv" : "shaders/vert.spv";
+		desc.fragmentShader = bindlessEnabled() ? "shaders/bindless_frag.spv" : "shaders/frag.spv";
+		desc.blend = blend;
+		desc.cullMode = cullMode;
+		desc.colorFormat = swapChainImageFormat;
+		desc.renderPass = renderPass;
+		desc.layout = pipelineLayout;
+
+		//编译期常量在建管线时折叠进着色器，热路径上不读uniform、没有死分支
+		float outputAlpha = blend == BlendMode::Alpha ? 0.5f : 1.0f;
+		desc.specialization.resize( SPEC_CONSTANT_COUNT );
+		desc.specialization[SPEC_OBJECT_PUSH_CONSTANTS] = config.objectPushConstants ? VK_TRUE : VK_FALSE;
+		std::memcpy( &desc.specialization[SPEC_OUTPUT_ALPHA], &outputAlpha, sizeof( float ) );
+		return desc;
+	}
+
+	//按描述创建一个图形管线。可能在管线管理器的后台线程上调用，只读取desc和线程安全的设备对象
+	VkPipeline buildGraphicsPipeline( const GraphicsPipelineDesc& desc )
+	{
+		//管线可编程功能：
+		AssetData vertShaderCode = loadAsset( desc.vertexShader );
+		AssetData fragShaderCode = loadAsset( desc.fragmentShader );
+
+		VkShaderModule vertShaderModule = createShaderModule( vertShaderCode.data, vertShaderCode.size );
+		VkShaderModule fragShaderModule = createShaderModule( fragShaderCode.data, fragShaderCode.size );
+
+		//每个常量4字节，着色器中没有声明的constant_id会被忽略
+		std::vector<VkSpecializationMapEntry> specializationEntries( desc.specialization.size() );
+		for (uint32_t i = 0; i < specializationEntries.size(); i++)
+		{
+			specializationEntries[i].constantID = i;
+			specializationEntries[i].offset = i * sizeof( uint32_t );
+			specializationEntries[i].size = sizeof( uint32_t );
+		}
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+		specializationInfo.pMapEntries = specializationEntries.data();
+		specializationInfo.dataSize = desc.specialization.size() * sizeof( uint32_t );
+		specializationInfo.pData = desc.specialization.data();
+
+		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;//告诉vulkan该shader插入管线的哪个阶段
+		vertShaderStageInfo.module = vertShaderModule;
+		vertShaderStageInfo.pName = "main";
+		vertShaderStageInfo.pSpecializationInfo = desc.specialization.empty() ? nullptr : &specializationInfo;
+
+		VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		fragShaderStageInfo.module = fragShaderModule;
+		fragShaderStageInfo.pName = "main";
+		fragShaderStageInfo.pSpecializationInfo = vertShaderStageInfo.pSpecializationInfo;
+
+		VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+		//管线固定功能：
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};//顶点输入
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions = { Vertex::getBindingDescription() };
+		auto vertexAttributes = Vertex::getAttributeDescriptions();
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions( vertexAttributes.begin(), vertexAttributes.end() );
+		if (desc.instanced)
+		{
+			bindingDescriptions.push_back( InstanceData::getBindingDescription() );
+			auto instanceAttributes = InstanceData::getAttributeDescriptions();
+			attributeDescriptions.insert( attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end() );
+		}
+
+		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+		vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};//输入汇编
+		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssembly.topology = desc.topology;//图元拓扑
+		inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+		VkPipelineViewportStateCreateInfo viewportState{};//视口和裁剪矩形（动态状态）
+		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportState.viewportCount = 1;
+		viewportState.scissorCount = 1;
+
+		VkPipelineRasterizationStateCreateInfo rasterizer{};//光栅化器
+		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizer.depthClampEnable = VK_FALSE;
+		rasterizer.rasterizerDiscardEnable = VK_FALSE;
+		rasterizer.polygonMode = desc.polygonMode;//确定如何为几何图形生成片元
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.cullMode = desc.cullMode;
+		rasterizer.frontFace = desc.frontFace;
+		rasterizer.depthBiasEnable = VK_FALSE;
+
+		VkPipelineMultisampleStateCreateInfo multisampling{};
+		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampling.sampleShadingEnable = VK_FALSE;
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		//每个帧缓冲区的混合配置
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;//确定传递的通道
+		colorBlendAttachment.blendEnable = desc.blend != BlendMode::Opaque;
+		colorBlendAttachment.srcColorBlendFactor = desc.blend == BlendMode::Alpha ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstColorBlendFactor = desc.blend == BlendMode::Alpha ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+		//全局混合配置
+		VkPipelineColorBlendStateCreateInfo colorBlending{};
+		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlending.logicOpEnable = VK_FALSE;
+		colorBlending.logicOp = VK_LOGIC_OP_COPY;
+		colorBlending.attachmentCount = 1;
+		colorBlending.pAttachments = &colorBlendAttachment;
+		colorBlending.blendConstants[0] = 0.0f;
+		colorBlending.blendConstants[1] = 0.0f;
+		colorBlending.blendConstants[2] = 0.0f;
+		colorBlending.blendConstants[3] = 0.0f;
+
+		std::vector<VkDynamicState> dynamicStates = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+		};
+		VkPipelineDynamicStateCreateInfo dynamicState{};
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+		dynamicState.pDynamicStates = dynamicStates.data();
+
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.stageCount = 2;
+		pipelineInfo.pStages = shaderStages;
+		pipelineInfo.pVertexInputState = &vertexInputInfo;
+		pipelineInfo.pInputAssemblyState = &inputAssembly;
+		pipelineInfo.pViewportState = &viewportState;
+		pipelineInfo.pRasterizationState = &rasterizer;
+		pipelineInfo.pMultisampleState = &multisampling;
+		pipelineInfo.pColorBlendState = &colorBlending;
+		pipelineInfo.pDynamicState = &dynamicState;
+		pipelineInfo.layout = desc.layout;
+		pipelineInfo.renderPass = desc.renderPass;
+		pipelineInfo.subpass = 0;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+		//动态渲染：管线只声明附件格式，不再依赖渲染通道的兼容性
+		VkPipelineRenderingCreateInfo renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+		renderingInfo.colorAttachmentCount = 1;
+		renderingInfo.pColorAttachmentFormats = &desc.colorFormat;
+		if (desc.renderPass == VK_NULL_HANDLE)
+		{
+			pipelineInfo.pNext = &renderingInfo;
+		}
+
+		//管线缓存是内部同步的，多个线程可以同时使用
+		VkPipeline pipeline;
+		VkResult result = vkCreateGraphicsPipelines( device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline );
+
+		vkDestroyShaderModule( device, fragShaderModule, nullptr );
+		vkDestroyShaderModule( device, vertShaderModule, nullptr );
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create graphics pipeline!" );
+		}
+		return pipeline;
+	}
+
+	//帧边界：重新编译好的SPIR-V交给管线管理器，被替换的旧管线等飞行中的帧完成后再销毁，不需要等待设备空闲
+	void applyShaderReloads()
+	{
+		for (const std::string& shaderPath : shaderWatcher.takeCompiled())
+		{
+			assetArchive.remove( shaderPath );//归档里的是旧版本
+			pipelineManager.reload( shaderPath );
+		}
+
+		std::vector<VkPipeline> replaced = pipelineManager.takeReplaced();
+		for (VkPipeline pipeline : replaced)
+		{
+			retirePipeline( pipeline );
+		}
+		if (!replaced.empty())
+		{
+			graphicsPipeline = pipelineManager.find( makePipelineDesc( BlendMode::Opaque, VK_CULL_MODE_BACK_BIT ) );
+		}
+	}
+
+	//选定本帧使用的管线变体。异步模式下变体还没编译好时先用基础管线绘制
+	void selectFramePipeline()
+	{
+		BlendMode blend = config.blendMode;
+		VkCullModeFlags cullMode = config.cullMode;
+		if (config.pipelineVariantInterval > 0)
+		{
+			const BlendMode blendModes[] = { BlendMode::Opaque, BlendMode::Alpha, BlendMode::Additive };
+			uint64_t variant = frameCounter / config.pipelineVariantInterval % 6;
+			blend = blendModes[variant % 3];
+			cullMode = variant / 3 == 0 ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE;
+		}
+
+		GraphicsPipelineDesc desc = makePipelineDesc( blend, cullMode );
+		activePipeline = config.asyncPipelineCompile ? pipelineManager.request( desc, graphicsPipeline ) : pipelineManager.get( desc );
+		if (activePipeline == graphicsPipeline && !(desc == makePipelineDesc( BlendMode::Opaque, VK_CULL_MODE_BACK_BIT )))
+		{
+			pipelineFallbackFrames++;
+		}
+	}
+
+	//视锥剔除：每个对象一个线程，可见对象写出一条VkDrawIndexedIndirectCommand
+	void createCullPipeline()
+	{
+		if (config.drawMode != DrawMode::Indirect)
+		{
+			return;
+		}
+
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+		//binding 0: uploadRing中的InstanceData数组，binding 1: 本帧的间接绘制区域
+		for (uint32_t i = 0; i < bindings.size(); i++)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout( device, &layoutInfo, nullptr, &cullDescriptorSetLayout ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create cull descriptor set layout!" );
+		}
+
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof( CullConstants );
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout( device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create cull pipeline layout!" );
+		}
+
+		cullPipeline = createComputePipeline( "shaders/cull.spv", cullPipelineLayout );
+	}
+
+	//计算管线只有一个着色器阶段，和图形管线共用管线缓存和创建耗时统计
+	VkPipeline createComputePipeline( const std::string& shaderPath, VkPipelineLayout layout )
+	{
+		AssetData compShaderCode = loadAsset( shaderPath );
+		VkShaderModule compShaderModule = createShaderModule( compShaderCode.data, compShaderCode.size );
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = compShaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = layout;
+
+		VkPipeline pipeline;
+		auto pipelineStart = std::chrono::steady_clock::now();
+		if (vkCreateComputePipelines( device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create compute pipeline!" );
+		}
+		pipelineCreationMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - pipelineStart ).count();
+		pipelineCount++;
+
+		vkDestroyShaderModule( device, compShaderModule, nullptr );
+		return pipeline;
+	}
+
+	void createFramebuffers()
+	{
+		if (config.dynamicRendering)
+		{
+			return;//不需要帧缓冲，调整窗口时只重建交换链和image view
+		}
+
+		swapChainFramebuffers.resize( swapChainImageViews.size() );
+
+		for (size_t i = 0; i < swapChainImageViews.size(); i++)
+		{
+			VkImageView attachments[] = {
+				swapChainImageViews[i]//来自交换链
+			};
+
+			VkFramebufferCreateInfo framebufferInfo{};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = renderPass;//只能将帧缓冲与它兼容的渲染通道一起使用！
+			framebufferInfo.attachmentCount = 1;
+			framebufferInfo.pAttachments = attachments;
+			framebufferInfo.width = swapChainExtent.width;
+			framebufferInfo.height = swapChainExtent.height;
+			framebufferInfo.layers = 1;
+
+			if (vkCreateFramebuffer( device, &framebufferInfo, nullptr, &swapChainFramebuffers[i] ) != VK_SUCCESS)
+			{
+				throw std::runtime_error( "failed to create framebuffer!" );
+			}
+		}
+	}
+
+	void createCommandPool()
+	{
+		QueueFamilyIndices queueFamilyIndices = findQueueFamilies( physicalDevice );
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();//命令池绑定一个队列族
+
+		if (vkCreateCommandPool( device, &poolInfo, nullptr, &commandPool ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create command pool!" );
+		}
+	}
+
+	void createVertexBuffer()
+	{
+		if (mesh.vertices.empty() || mesh.indices.empty())
+		{
+			throw std::runtime_error( "mesh has no vertices or indices!" );
+		}
+
+		VkDeviceSize bufferSize = sizeof( mesh.vertices[0] ) * mesh.vertices.size();
+		createDeviceLocalBuffer( mesh.vertices.data(), bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexBufferMemory,
+			VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT );
+	}
+
+	void createIndexBuffer()
+	{
+		VkDeviceSize bufferSize = sizeof( mesh.indices[0] ) * mesh.indices.size();
+		createDeviceLocalBuffer( mesh.indices.data(), bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexBufferMemory,
+			VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT );
+	}
+
+	//每个飞行中的帧一段区域，大小按场景需要的每帧数据计算
+	void createUploadRing()
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties( physicalDevice, &properties );
+		uniformAlignment = properties.limits.minUniformBufferOffsetAlignment;
+		storageAlignment = properties.limits.minStorageBufferOffsetAlignment;
+		objectConstantsStride = alignUp( sizeof( ObjectConstants ), uniformAlignment );
+
+		VkDeviceSize perObjectSize = objectConstantsStride;
+		if (config.drawMode != DrawMode::PerObject)
+		{
+			perObjectSize = sizeof( InstanceData );
+		}
+		else if (bindlessEnabled())
+		{
+			perObjectSize = sizeof( ObjectConstants );//storage缓冲区中紧密排列
+		}
+		else if (config.objectPushConstants)
+		{
+			perObjectSize = 0;
+		}
+		VkDeviceSize regionSize = alignUp( sizeof( FrameConstants ), uniformAlignment ) + perObjectSize * scene.objects.size();
+		regionSize = alignUp( regionSize + storageAlignment, uniformAlignment );//实例数据按两种对齐中较大的对齐
+
+		createBuffer( regionSize * maxFramesInFlight, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uploadRingBuffer, uploadRingMemory, true );
+		uploadRing.init( uploadRingBuffer, uploadRingMemory.mapped, regionSize, maxFramesInFlight );
+	}
+
+	//剔除输出，GPU写GPU读，放在device local内存
+	void createDrawCommandBuffer()
+	{
+		if (config.drawMode != DrawMode::Indirect)
+		{
+			return;
+		}
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties( physicalDevice, &properties );
+		if (scene.objects.size() > properties.limits.maxDrawIndirectCount)
+		{
+			throw std::runtime_error( "object count exceeds maxDrawIndirectCount!" );
+		}
+
+		drawCommandRegionSize = alignUp( DRAW_COMMANDS_OFFSET + sizeof( VkDrawIndexedIndirectCommand ) * scene.objects.size(), storageAlignment );
+		createBuffer( drawCommandRegionSize * maxFramesInFlight,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCommandBuffer, drawCommandBufferMemory, true );
+
+		for (const Vertex& vertex : mesh.vertices)
+		{
+			meshBoundingRadius = std::max( meshBoundingRadius, std::sqrt( vertex.pos.x * vertex.pos.x + vertex.pos.y * vertex.pos.y ) );
+		}
+	}
+
+	void createDescriptorAllocators()
+	{
+		//每帧的集合：图形的动态uniform加材质纹理集合和剔除的动态storage集合
+		std::vector<VkDescriptorPoolSize> poolSizes( 3 );
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		poolSizes[0].descriptorCount = 2 * FRAME_DESCRIPTOR_SETS_PER_POOL;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		poolSizes[1].descriptorCount = 2 * FRAME_DESCRIPTOR_SETS_PER_POOL;
+		poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[2].descriptorCount = FRAME_DESCRIPTOR_SETS_PER_POOL;
+		frameDescriptors.init( device, maxFramesInFlight, poolSizes, FRAME_DESCRIPTOR_SETS_PER_POOL );
+
+		if (!bindlessEnabled())
+		{
+			return;
+		}
+
+		std::array<VkDescriptorPoolSize, 2> bindlessSizes{};
+		bindlessSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindlessSizes[0].descriptorCount = BINDLESS_MAX_BUFFERS;
+		bindlessSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindlessSizes[1].descriptorCount = BINDLESS_MAX_TEXTURES;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(bindlessSizes.size());
+		poolInfo.pPoolSizes = bindlessSizes.data();
+		poolInfo.maxSets = 1;
+
+		if (vkCreateDescriptorPool( device, &poolInfo, nullptr, &bindlessPool ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create bindless descriptor pool!" );
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = bindlessPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &bindlessSetLayout;
+
+		if (vkAllocateDescriptorSets( device, &allocInfo, &bindlessSet ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to allocate bindless descriptor set!" );
+		}
+
+		objectBufferIndex = registerBindlessBuffer( uploadRing.getBuffer(), 0, VK_WHOLE_SIZE );
+		textures[0].bindlessIndex = registerBindlessTexture( textures[0].view, textureSampler );
+	}
+
+	//返回缓冲区在bindless数组中的下标。元素带UPDATE_AFTER_BIND，飞行中的帧不受影响
+	uint32_t registerBindlessBuffer( VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range )
+	{
+		if (bindlessBufferCount == BINDLESS_MAX_BUFFERS)
+		{
+			throw std::runtime_error( "bindless buffer array is full!" );
+		}
+
+		VkDescriptorBufferInfo bufferInfo{};
+		bufferInfo.buffer = buffer;
+		bufferInfo.offset = offset;
+		bufferInfo.range = range;
+
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = bindlessSet;
+		descriptorWrite.dstBinding = 0;
+		descriptorWrite.dstArrayElement = bindlessBufferCount;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets( device, 1, &descriptorWrite, 0, nullptr );
+		return bindlessBufferCount++;
+	}
+
+	uint32_t registerBindlessTexture( VkImageView imageView, VkSampler sampler )
+	{
+		if (bindlessTextureCount == BINDLESS_MAX_TEXTURES)
+		{
+			throw std::runtime_error( "bindless texture array is full!" );
+		}
+
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = imageView;
+		imageInfo.sampler = sampler;
+
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = bindlessSet;
+		descriptorWrite.dstBinding = 1;
+		descriptorWrite.dstArrayElement = bindlessTextureCount;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets( device, 1, &descriptorWrite, 0, nullptr );
+		return bindlessTextureCount++;
+	}
+
+	//本帧的描述符集从frameDescriptors分配，帧开始时整个池一起重置，写入时不用担心还在飞行中的帧
+	void allocateFrameDescriptorSets()
+	{
+		descriptorSet = frameDescriptors.allocate( descriptorSetLayout );
+
+		std::array<VkDescriptorBufferInfo, 2> bufferInfos{};
+		bufferInfos[0].buffer = uploadRing.getBuffer();
+		bufferInfos[0].offset = 0;
+		bufferInfos[0].range = sizeof( FrameConstants );
+		bufferInfos[1].buffer = uploadRing.getBuffer();
+		bufferInfos[1].offset = 0;
+		bufferInfos[1].range = sizeof( ObjectConstants );
+
+		//材质纹理还在加载时采样占位纹理，切换发生在它就绪之后的下一帧
+		const Texture& texture = textures[materialTexture].resident ? textures[materialTexture] : textures[0];
+		if (!textures[materialTexture].resident)
+		{
+			texturePlaceholderFrames++;
+		}
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = texture.view;
+		imageInfo.sampler = textureSampler;
+
+		std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+		for (uint32_t i = 0; i < bufferInfos.size(); i++)
+		{
+			descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[i].dstSet = descriptorSet;
+			descriptorWrites[i].dstBinding = i;
+			descriptorWrites[i].dstArrayElement = 0;
+			descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			descriptorWrites[i].descriptorCount = 1;
+			descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+		}
+		descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[2].dstSet = descriptorSet;
+		descriptorWrites[2].dstBinding = 2;
+		descriptorWrites[2].dstArrayElement = 0;
+		descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[2].descriptorCount = 1;
+		descriptorWrites[2].pImageInfo = &imageInfo;
+
+		vkUpdateDescriptorSets( device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr );
+
+		if (config.drawMode != DrawMode::Indirect)
+		{
+			return;
+		}
+
+		cullDescriptorSet = frameDescriptors.allocate( cullDescriptorSetLayout );
+
+		//两者都用动态偏移选择本帧的区域
+		std::array<VkDescriptorBufferInfo, 2> cullBufferInfos{};
+		cullBufferInfos[0].buffer = uploadRing.getBuffer();
+		cullBufferInfos[0].offset = 0;
+		cullBufferInfos[0].range = sizeof( InstanceData ) * scene.objects.size();
+		cullBufferInfos[1].buffer = drawCommandBuffer;
+		cullBufferInfos[1].offset = 0;
+		cullBufferInfos[1].range = drawCommandRegionSize;
+
+		std::array<VkWriteDescriptorSet, 2> cullWrites{};
+		for (uint32_t i = 0; i < cullWrites.size(); i++)
+		{
+			cullWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			cullWrites[i].dstSet = cullDescriptorSet;
+			cullWrites[i].dstBinding = i;
+			cullWrites[i].dstArrayElement = 0;
+			cullWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			cullWrites[i].descriptorCount = 1;
+			cullWrites[i].pBufferInfo = &cullBufferInfos[i];
+		}
+
+		vkUpdateDescriptorSets( device, static_cast<uint32_t>(cullWrites.size()), cullWrites.data(), 0, nullptr );
+	}
+
+	//把本帧的常量和每个对象的变换写入uploadRing中当前帧的区域
+	void updateFrameData()
+	{
+		uploadRing.beginFrame( currentFrame );
+
+		//按帧号推进的固定时间步长，benchmark结果可复现
+		float time = static_cast<float>(frameCounter) / 60.0f;
+
+		void* data;
+		frameConstantsOffset = uploadRing.allocate( sizeof( FrameConstants ), uniformAlignment, &data );
+		FrameConstants* frameConstants = static_cast<FrameConstants*>(data);
+		viewProj = glm::scale( glm::mat4( 1.0f ), glm::vec3( config.cameraZoom, config.cameraZoom, 1.0f ) );
+		frameConstants->viewProj = viewProj;
+		frameConstants->params = glm::vec4( time, 0.0f, 0.0f, 0.0f );
+
+		if (config.drawMode != DrawMode::PerObject)
+		{
+			instanceDataOffset = uploadRing.allocate( sizeof( InstanceData ) * scene.objects.size(), std::max( uniformAlignment, storageAlignment ), &data );
+			InstanceData* instances = static_cast<InstanceData*>(data);
+			for (size_t i = 0; i < scene.objects.size(); i++)
+			{
+				const SceneObject& object = scene.objects[i];
+				instances[i].transform = glm::vec4( object.position, object.scale, object.rotationSpeed * time );
+				instances[i].color = object.color;
+			}
+			return;
+		}
+
+		char* objectData = nullptr;
+		VkDeviceSize stride = objectConstantsStride;
+		if (bindlessEnabled())
+		{
+			//着色器按vec4读取，偏移至少16字节对齐
+			stride = sizeof( ObjectConstants );
+			objectConstantsOffset = uploadRing.allocate( stride * scene.objects.size(), std::max<VkDeviceSize>( storageAlignment, 16 ), &data );
+			objectData = static_cast<char*>(data);
+		}
+		else if (config.objectPushConstants)
+		{
+			objectConstants.resize( scene.objects.size() );
+		}
+		else
+		{
+			objectConstantsOffset = uploadRing.allocate( stride * scene.objects.size(), uniformAlignment, &data );
+			objectData = static_cast<char*>(data);
+		}
+		for (size_t i = 0; i < scene.objects.size(); i++)
+		{
+			const SceneObject& object = scene.objects[i];
+			ObjectConstants* constants = objectData ? reinterpret_cast<ObjectConstants*>(objectData + stride * i) : &objectConstants[i];
+			glm::mat4 model = glm::translate( glm::mat4( 1.0f ), glm::vec3( object.position, 0.0f ) );
+			model = glm::rotate( model, object.rotationSpeed * time, glm::vec3( 0.0f, 0.0f, 1.0f ) );
+			constants->model = glm::scale( model, glm::vec3( object.scale ) );
+			constants->color = object.color;
+		}
+	}
+
+	//通过host visible的暂存缓冲区把数据上传到device local缓冲区（GPU读取最快的内存）
+	//dstAccess/dstStage描述图形队列第一次使用该缓冲区的方式
+	void createDeviceLocalBuffer( const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, GpuAllocation& bufferMemory,
+		VkAccessFlags dstAccess, VkPipelineStageFlags dstStage )
+	{
+		createBuffer( size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory );
+		uploadBuffer( data, size, buffer, dstAccess, dstStage );
+	}
+
+	bool asyncUploadsEnabled() const
+	{
+		return transferCommandPool != VK_NULL_HANDLE;
+	}
+
+	//需要专用传输队列族和时间线信号量（用来把传输完成交给图形队列），否则上传在图形队列上同步完成
+	void createTransferResources()
+	{
+		QueueFamilyIndices indices = findQueueFamilies( physicalDevice );
+		graphicsFamily = indices.graphicsFamily.value();
+		if (!config.useTransferQueue || !indices.transferFamily.has_value() || !timelineSemaphoreSupported)
+		{
+			return;
+		}
+		transferFamily = indices.transferFamily.value();
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = transferFamily;
+
+		if (vkCreateCommandPool( device, &poolInfo, nullptr, &transferCommandPool ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create transfer command pool!" );
+		}
+
+		VkSemaphoreTypeCreateInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		timelineInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &timelineInfo;
+
+		if (vkCreateSemaphore( device, &semaphoreInfo, nullptr, &transferTimeline ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create transfer timeline semaphore!" );
+		}
+	}
+
+	bool asyncComputeEnabled() const
+	{
+		return computeCommandPool != VK_NULL_HANDLE;
+	}
+
+	//只有间接绘制有每帧的计算工作。需要独立的计算队列族和时间线信号量，否则剔除仍在图形命令缓冲区里录制
+	void createComputeResources()
+	{
+		QueueFamilyIndices indices = findQueueFamilies( physicalDevice );
+		if (!config.useAsyncCompute || config.drawMode != DrawMode::Indirect || !indices.computeFamily.has_value() || !timelineSemaphoreSupported)
+		{
+			return;
+		}
+		computeFamily = indices.computeFamily.value();
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.queueFamilyIndex = computeFamily;
+
+		if (vkCreateCommandPool( device, &poolInfo, nullptr, &computeCommandPool ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create compute command pool!" );
+		}
+
+		computeCommandBuffers.resize( maxFramesInFlight );
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = computeCommandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = (uint32_t)computeCommandBuffers.size();
+
+		if (vkAllocateCommandBuffers( device, &allocInfo, computeCommandBuffers.data() ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to allocate compute command buffers!" );
+		}
+
+		VkSemaphoreTypeCreateInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		timelineInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &timelineInfo;
+
+		if (vkCreateSemaphore( device, &semaphoreInfo, nullptr, &computeTimeline ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create compute timeline semaphore!" );
+		}
+	}
+
+	//本帧的剔除提交到计算队列，不等待任何东西：实例数据由主机写入（提交时可见），
+	//该槽位的间接绘制区域和命令缓冲区在waitForFrameSlot之后已经不再被使用
+	void submitCompute()
+	{
+		VkCommandBuffer commandBuffer = computeCommandBuffers[currentFrame];
+		vkResetCommandBuffer( commandBuffer, 0 );
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer( commandBuffer, &beginInfo ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to begin recording compute command buffer!" );
+		}
+		//剔除的两个查询由计算命令缓冲区重置，其余查询由图形命令缓冲区重置
+		if (cullTimestampsSupported)
+		{
+			vkCmdResetQueryPool( commandBuffer, timestampQueryPool, currentFrame * TIMESTAMPS_PER_FRAME + TIMESTAMP_CULL_BEGIN,
+				TIMESTAMPS_PER_FRAME - TIMESTAMP_CULL_BEGIN );
+		}
+		computeGraph.setBuffer( computeDrawCommandsResource, drawCommandBuffer, drawCommandRegionSize * currentFrame, drawCommandRegionSize );
+		computeGraph.execute( commandBuffer );
+		if (vkEndCommandBuffer( commandBuffer ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to record compute command buffer!" );
+		}
+
+		uint64_t signalValue = frameCounter + 1;
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineSubmitInfo.signalSemaphoreValueCount = 1;
+		timelineSubmitInfo.pSignalSemaphoreValues = &signalValue;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineSubmitInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &computeTimeline;
+
+		if (vkQueueSubmit( computeQueue, 1, &submitInfo, VK_NULL_HANDLE ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to submit compute command buffer!" );
+		}
+	}
+
+	//把data复制到dstBuffer（调用者可以在任意线程调用）。异步时暂存缓冲区在获取它的图形帧完成后回收
+	void uploadBuffer( const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage )
+	{
+		VkBuffer stagingBuffer;
+		GpuAllocation stagingBufferMemory;
+		createBuffer( size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory );
+		memcpy( stagingBufferMemory.mapped, data, static_cast<size_t>(size) );//分配器已经持久映射
+
+		if (!asyncUploadsEnabled())
+		{
+			copyBuffer( stagingBuffer, dstBuffer, size );
+			vkDestroyBuffer( device, stagingBuffer, nullptr );
+			allocator.free( stagingBufferMemory );
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock( uploadMutex );
+		VkCommandBuffer commandBuffer = beginTransferCommands();
+
+		VkBufferCopy copyRegion{};
+		copyRegion.size = size;
+		vkCmdCopyBuffer( commandBuffer, stagingBuffer, dstBuffer, 1, &copyRegion );
+
+		//释放所有权：dstAccessMask在释放操作中被忽略，可见性由图形队列上的获取操作负责
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+		barrier.buffer = dstBuffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr );
+
+		PendingAcquire acquire{};
+		acquire.isImage = false;
+		acquire.bufferBarrier = barrier;
+		acquire.bufferBarrier.srcAccessMask = 0;//获取操作中srcAccessMask被忽略
+		acquire.bufferBarrier.dstAccessMask = dstAccess;
+		acquire.dstStage = dstStage;
+		acquire.release = [this, stagingBuffer, stagingBufferMemory]() mutable
+			{
+				vkDestroyBuffer( device, stagingBuffer, nullptr );
+				allocator.free( stagingBufferMemory );
+			};
+		submitTransferCommands( commandBuffer, acquire, size );
+	}
+
+	//把暂存数据按regions复制到image的各个mip级别，完成后图像处于SHADER_READ_ONLY_OPTIMAL，供片元着色器采样
+	void uploadImage( const void* data, VkDeviceSize size, VkImage image, uint32_t mipLevels, const std::vector<VkBufferImageCopy>& regions )
+	{
+		VkBuffer stagingBuffer;
+		GpuAllocation stagingBufferMemory;
+		createBuffer( size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory );
+		memcpy( stagingBufferMemory.mapped, data, static_cast<size_t>(size) );
+
+		bool async = asyncUploadsEnabled();
+		std::unique_lock<std::mutex> lock( uploadMutex, std::defer_lock );
+		VkCommandBuffer commandBuffer;
+		if (async)
+		{
+			lock.lock();
+			commandBuffer = beginTransferCommands();
+		}
+		else
+		{
+			commandBuffer = beginSingleTimeCommands();
+		}
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = mipLevels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+		vkCmdCopyBufferToImage( commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data() );
+
+		//异步时这同时是所有权释放，布局转换在释放和获取中各写一次且必须一致
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		if (!async)
+		{
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+			endSingleTimeCommands( commandBuffer );
+			vkDestroyBuffer( device, stagingBuffer, nullptr );
+			allocator.free( stagingBufferMemory );
+			return;
+		}
+
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+		vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+		PendingAcquire acquire{};
+		acquire.isImage = true;
+		acquire.imageBarrier = barrier;
+		acquire.imageBarrier.srcAccessMask = 0;
+		acquire.imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		acquire.dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		acquire.release = [this, stagingBuffer, stagingBufferMemory]() mutable
+			{
+				vkDestroyBuffer( device, stagingBuffer, nullptr );
+				allocator.free( stagingBufferMemory );
+			};
+		submitTransferCommands( commandBuffer, acquire, size );
+	}
+
+	//调用者持有uploadMutex
+	VkCommandBuffer beginTransferCommands()
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = transferCommandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers( device, &allocInfo, &commandBuffer ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to allocate transfer command buffer!" );
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer( commandBuffer, &beginInfo );
+		return commandBuffer;
+	}
+
+	//提交后不等待：完成时transferTimeline达到新的值，图形帧在获取所有权前等待这个值。调用者持有uploadMutex
+	void submitTransferCommands( VkCommandBuffer commandBuffer, PendingAcquire acquire, VkDeviceSize size )
+	{
+		vkEndCommandBuffer( commandBuffer );
+
+		uint64_t signalValue = ++transferTimelineValue;
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineSubmitInfo.signalSemaphoreValueCount = 1;
+		timelineSubmitInfo.pSignalSemaphoreValues = &signalValue;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineSubmitInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &transferTimeline;
+
+		if (vkQueueSubmit( transferQueue, 1, &submitInfo, VK_NULL_HANDLE ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to submit transfer command buffer!" );
+		}
+
+		//命令缓冲区和暂存数据一起回收，回收时同样需要持有uploadMutex
+		std::function<void()> releaseStaging = std::move( acquire.release );
+		acquire.release = [this, commandBuffer, releaseStaging]()
+			{
+				std::lock_guard<std::mutex> lock( uploadMutex );
+				vkFreeCommandBuffers( device, transferCommandPool, 1, &commandBuffer );
+				releaseStaging();
+			};
+		acquire.transferValue = signalValue;
+		pendingAcquires.push_back( std::move( acquire ) );
+		asyncUploadCount++;
+		asyncUploadBytes += size;
+	}
+
+	//在本帧命令缓冲区开头获取异步上传的所有权，记下提交时需要等待的transferTimeline值（0表示不需要等待）
+	void recordUploadAcquires( VkCommandBuffer commandBuffer )
+	{
+		frameUploadWaitValue = 0;
+		frameUploadWaitStages = 0;
+		{
+			//纹理上传和它的获取屏障在同一次加锁中取走，mip生成一定录制在获取之后
+			std::lock_guard<std::mutex> lock( uploadMutex );
+			frameAcquires.swap( pendingAcquires );
+			frameTextureUploads.swap( pendingTextureUploads );
+		}
+
+		for (const PendingAcquire& acquire : frameAcquires)
+		{
+			//srcStage与提交时的信号量等待阶段相同，构成依赖链
+			if (acquire.isImage)
+			{
+				vkCmdPipelineBarrier( commandBuffer, acquire.dstStage, acquire.dstStage, 0, 0, nullptr, 0, nullptr, 1, &acquire.imageBarrier );
+			}
+			else
+			{
+				vkCmdPipelineBarrier( commandBuffer, acquire.dstStage, acquire.dstStage, 0, 0, nullptr, 1, &acquire.bufferBarrier, 0, nullptr );
+			}
+			frameUploadWaitValue = std::max( frameUploadWaitValue, acquire.transferValue );
+			frameUploadWaitStages |= acquire.dstStage;
+		}
+	}
+
+	//占位纹理同步创建，材质纹理交给加载线程
+	void createTextureResources()
+	{
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (vkCreateSampler( device, &samplerInfo, nullptr, &textureSampler ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create texture sampler!" );
+		}
+
+		//1x1白色，采样结果与没有纹理时相同
+		const uint32_t white = 0xFFFFFFFF;
+		Texture placeholder;
+		createImage( 1, 1, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, placeholder.image, placeholder.memory );
+		VkBufferImageCopy region{};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = { 1, 1, 1 };
+		uploadImage( &white, sizeof( white ), placeholder.image, 1, { region } );
+		placeholder.view = createTextureView( placeholder.image, VK_FORMAT_R8G8B8A8_UNORM, 1 );
+		placeholder.resident = true;//异步上传时第一帧获取所有权，占位纹理在第一帧之前不会被采样
+		textures.push_back( placeholder );
+
+		if (config.texturePath.empty())
+		{
+			return;
+		}
+
+		createBuffer( TEXTURE_STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			textureStagingBuffer, textureStagingMemory );
+		textureStaging.init( textureStagingBuffer, textureStagingMemory.mapped, TEXTURE_STAGING_SIZE );
+		textureLoader.start( TEXTURE_LOAD_THREADS );
+		materialTexture = requestTexture( config.texturePath );
+	}
+
+	VkImageView createTextureView( VkImage image, VkFormat format, uint32_t mipLevels )
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = format;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = mipLevels;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		VkImageView imageView;
+		if (vkCreateImageView( device, &viewInfo, nullptr, &imageView ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create texture image view!" );
+		}
+		return imageView;
+	}
+
+	//返回纹理下标，立即可用（就绪前采样占位纹理）
+	uint32_t requestTexture( const std::string& path )
+	{
+		uint32_t index = static_cast<uint32_t>(textures.size());
+		textures.push_back( Texture{} );
+		auto requested = std::chrono::steady_clock::now();
+		textureLoader.post( [this, index, path, requested]() { loadTexture( index, path, requested ); } );
+		return index;
+	}
+
+	//在加载线程上执行：解码、写入暂存环形缓冲区、创建图像并提交复制。不访问textures
+	void loadTexture( uint32_t index, const std::string& path, std::chrono::steady_clock::time_point requested )
+	{
+		//交给图形帧之前失败时由catch释放
+		StagingRing::Allocation staging;
+		bool stagingAllocated = false;
+		TextureUpload upload{};
+		try
+		{
+			auto decodeStart = std::chrono::steady_clock::now();
+			DecodedImage decoded;
+			decodeImage( loadAsset( path ), decoded );
+			bool cpuFallback = isBlockCompressed( decoded.format ) && compressedFormats.count( decoded.format ) == 0;
+			if (cpuFallback)
+			{
+				decodeBlockCompressedToRgba8( decoded );
+			}
+			double decodeMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - decodeStart ).count();
+
+			//PNG和levelCount为0的KTX2生成完整的mip链，前提是格式支持线性过滤的blit（压缩格式不支持）
+			uint32_t levelsProvided = static_cast<uint32_t>(decoded.levelOffsets.size());
+			uint32_t mipLevels = levelsProvided;
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties( physicalDevice, decoded.format, &formatProperties );
+			const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+			if (decoded.generateMips && (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures)
+			{
+				mipLevels = static_cast<uint32_t>(std::floor( std::log2( std::max( decoded.width, decoded.height ) ) )) + 1;
+			}
+
+			//各级别按16字节对齐放进暂存区，满足任何格式对bufferOffset的要求。KTX2直接从文件映射复制
+			std::vector<VkDeviceSize> stagingOffsets;
+			VkDeviceSize stagingSize = 0;
+			for (size_t level = 0; level < levelsProvided; level++)
+			{
+				stagingOffsets.push_back( alignUp( stagingSize, 16 ) );
+				stagingSize = stagingOffsets.back() + decoded.levelSizes[level];
+			}
+			if (!textureStaging.allocate( stagingSize, 16, staging ))
+			{
+				return;//正在退出
+			}
+			stagingAllocated = true;
+			for (size_t level = 0; level < levelsProvided; level++)
+			{
+				std::memcpy( textureStaging.getMapped( staging.offset + stagingOffsets[level] ), decoded.levelData( level ), static_cast<size_t>(decoded.levelSizes[level]) );
+			}
+
+			upload.texture = index;
+			upload.width = decoded.width;
+			upload.height = decoded.height;
+			upload.mipLevels = mipLevels;
+			upload.levelsProvided = levelsProvided;
+			upload.size = stagingSize;
+			upload.format = decoded.format;
+			upload.cpuFallback = cpuFallback;
+			upload.decodeMs = decodeMs;
+			upload.requested = requested;
+			upload.staging = staging;
+			for (uint32_t level = 0; level < levelsProvided; level++)
+			{
+				VkBufferImageCopy region{};
+				region.bufferOffset = staging.offset + stagingOffsets[level];
+				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.imageSubresource.mipLevel = level;
+				region.imageSubresource.layerCount = 1;
+				region.imageExtent = { std::max( decoded.width >> level, 1u ), std::max( decoded.height >> level, 1u ), 1 };
+				upload.regions.push_back( region );
+			}
+			createImage( decoded.width, decoded.height, decoded.format, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				upload.image, upload.memory, mipLevels );
+			upload.view = createTextureView( upload.image, decoded.format, mipLevels );
+
+			std::lock_guard<std::mutex> lock( uploadMutex );
+			upload.copied = asyncUploadsEnabled();
+			if (upload.copied)
+			{
+				submitTextureCopy( upload );
+			}
+			pendingTextureUploads.push_back( std::move( upload ) );
+		}
+		catch (const std::exception& e)
+		{
+			//暂存空间按分配顺序回收，不释放的话之后的纹理上传都会卡在它后面
+			if (stagingAllocated)
+			{
+				textureStaging.free( staging );
+			}
+			if (upload.view != VK_NULL_HANDLE)
+			{
+				vkDestroyImageView( device, upload.view, nullptr );
+			}
+			if (upload.image != VK_NULL_HANDLE)
+			{
+				vkDestroyImage( device, upload.image, nullptr );
+			}
+			allocator.free( upload.memory );
+			std::cerr << "failed to load texture " << path << ": " << e.what() << std::endl;
+			textureLoadFailures++;
+		}
+	}
+
+	//传输队列上复制全部级别并释放所有权，图像保持TRANSFER_DST_OPTIMAL留给图形队列生成mip。调用者持有uploadMutex
+	void submitTextureCopy( const TextureUpload& upload )
+	{
+		VkCommandBuffer commandBuffer = beginTransferCommands();
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = upload.image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = upload.mipLevels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+		vkCmdCopyBufferToImage( commandBuffer, textureStaging.getBuffer(), upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(upload.regions.size()), upload.regions.data() );
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+		vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+		PendingAcquire acquire{};
+		acquire.isImage = true;
+		acquire.imageBarrier = barrier;
+		acquire.imageBarrier.srcAccessMask = 0;
+		acquire.imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		acquire.dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		acquire.release = []() {};//暂存空间在mip生成的帧完成后释放
+		submitTransferCommands( commandBuffer, acquire, upload.size );
+	}
+
+	//在获取了所有权的帧里生成mip，转换到着色器只读布局。纹理从下一帧开始被采样
+	void recordTextureUploads( VkCommandBuffer commandBuffer )
+	{
+		for (TextureUpload& upload : frameTextureUploads)
+		{
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = upload.image;
+			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.baseArrayLayer = 0;
+			barrier.subresourceRange.layerCount = 1;
+
+			//没有传输队列时复制也录制在图形帧里
+			if (!upload.copied)
+			{
+				barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.subresourceRange.baseMipLevel = 0;
+				barrier.subresourceRange.levelCount = upload.mipLevels;
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+				vkCmdCopyBufferToImage( commandBuffer, textureStaging.getBuffer(), upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					static_cast<uint32_t>(upload.regions.size()), upload.regions.data() );
+			}
+
+			//用最后一个自带的级别逐级缩小生成其余级别，每个级别用作源之后转换到着色器只读
+			uint32_t lastProvided = upload.levelsProvided - 1;
+			if (lastProvided > 0)
+			{
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				barrier.subresourceRange.baseMipLevel = 0;
+				barrier.subresourceRange.levelCount = lastProvided;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+			}
+
+			barrier.subresourceRange.levelCount = 1;
+			int32_t mipWidth = static_cast<int32_t>(std::max( upload.width >> lastProvided, 1u ));
+			int32_t mipHeight = static_cast<int32_t>(std::max( upload.height >> lastProvided, 1u ));
+			for (uint32_t level = upload.levelsProvided; level < upload.mipLevels; level++)
+			{
+				barrier.subresourceRange.baseMipLevel = level - 1;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+				VkImageBlit blit{};
+				blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+				blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				blit.srcSubresource.mipLevel = level - 1;
+				blit.srcSubresource.layerCount = 1;
+				mipWidth = std::max( mipWidth / 2, 1 );
+				mipHeight = std::max( mipHeight / 2, 1 );
+				blit.dstOffsets[1] = { mipWidth, mipHeight, 1 };
+				blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				blit.dstSubresource.mipLevel = level;
+				blit.dstSubresource.layerCount = 1;
+				vkCmdBlitImage( commandBuffer, upload.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR );
+
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+				barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+			}
+
+			//最后一个级别只被写入过
+			barrier.subresourceRange.baseMipLevel = upload.mipLevels - 1;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+			Texture& texture = textures[upload.texture];
+			texture.image = upload.image;
+			texture.memory = upload.memory;
+			texture.view = upload.view;
+			texture.resident = true;
+			if (bindlessEnabled())
+			{
+				texture.bindlessIndex = registerBindlessTexture( texture.view, textureSampler );
+			}
+			texturesLoaded++;
+			textureUploadBytes += upload.size;
+			textureFormat = upload.format;
+			textureGpuBytes += upload.memory.size;
+			for (uint32_t level = 0; level < upload.mipLevels; level++)
+			{
+				textureRgba8Bytes += static_cast<VkDeviceSize>(std::max( upload.width >> level, 1u )) * std::max( upload.height >> level, 1u ) * 4;
+			}
+			textureCpuFallbacks += upload.cpuFallback ? 1 : 0;
+			textureDecodeMs += upload.decodeMs;
+			textureUploadMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - upload.requested ).count();
+
+			StagingRing::Allocation staging = upload.staging;
+			deletionQueue.push( frameCounter, [this, staging]() { textureStaging.free( staging ); } );
+		}
+		frameTextureUploads.clear();
+	}
+
+	//mainLoop结束、等待设备空闲之前调用：唤醒等待暂存空间的加载线程并等它们退出
+	void stopTextureLoading()
+	{
+		textureStaging.shutdown();
+		textureLoader.stop();
+	}
+
+	//设备空闲后调用，包括还没来得及生成mip的上传
+	void destroyTextures()
+	{
+		for (std::vector<TextureUpload>* uploads : { &pendingTextureUploads, &frameTextureUploads })
+		{
+			for (TextureUpload& upload : *uploads)
+			{
+				textures[upload.texture].image = upload.image;
+				textures[upload.texture].memory = upload.memory;
+				textures[upload.texture].view = upload.view;
+			}
+			uploads->clear();
+		}
+		for (Texture& texture : textures)
+		{
+			vkDestroyImageView( device, texture.view, nullptr );
+			vkDestroyImage( device, texture.image, nullptr );
+			allocator.free( texture.memory );
+		}
+		textures.clear();
+		vkDestroySampler( device, textureSampler, nullptr );
+		if (textureStagingBuffer != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer( device, textureStagingBuffer, nullptr );
+			allocator.free( textureStagingMemory );
+		}
+	}
+
+	//sharedWithCompute：图形和异步计算队列每帧都要访问的缓冲区使用并发共享，省去每帧的所有权转移
+	void createBuffer( VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, GpuAllocation& bufferMemory,
+		bool sharedWithCompute = false )
+	{
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		uint32_t queueFamilyIndices[] = { graphicsFamily, computeFamily };
+		if (sharedWithCompute && asyncComputeEnabled())
+		{
+			bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			bufferInfo.queueFamilyIndexCount = 2;
+			bufferInfo.pQueueFamilyIndices = queueFamilyIndices;
+		}
+
+		if (vkCreateBuffer( device, &bufferInfo, nullptr, &buffer ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create buffer!" );
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements( device, buffer, &memRequirements );
+
+		bufferMemory = allocator.allocate( memRequirements, properties, GpuResourceKind::Buffer );
+		vkBindBufferMemory( device, buffer, bufferMemory.memory, bufferMemory.offset );
+	}
+
+	void copyBuffer( VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size )
+	{
+		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+		VkBufferCopy copyRegion{};
+		copyRegion.size = size;
+		vkCmdCopyBuffer( commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion );
+
+		endSingleTimeCommands( commandBuffer );
+	}
+
+	//图形队列上的一次性命令，提交后等待完成（没有专用传输队列时的上传路径）
+	VkCommandBuffer beginSingleTimeCommands()
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = commandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		vkAllocateCommandBuffers( device, &allocInfo, &commandBuffer );
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;//只提交一次
+
+		vkBeginCommandBuffer( commandBuffer, &beginInfo );
+		return commandBuffer;
+	}
+
+	void endSingleTimeCommands( VkCommandBuffer commandBuffer )
+	{
+		vkEndCommandBuffer( commandBuffer );
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+
+		vkQueueSubmit( graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
+		vkQueueWaitIdle( graphicsQueue );//等待复制完成
+
+		vkFreeCommandBuffers( device, commandPool, 1, &commandBuffer );
+	}
+
+	void createCommandBuffers()
+	{
+		commandBuffers.resize( maxFramesInFlight );
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+
+		if (vkAllocateCommandBuffers( device, &allocInfo, commandBuffers.data() ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to allocate command buffers!" );
+		}
+	}
+
+	//命令池不是线程安全的，所以每个线程每帧一个；帧开始录制时整个池一起重置，比逐个重置命令缓冲区便宜
+	void createWorkerCommandBuffers()
+	{
+		uint32_t threadCount = config.recordThreads;
+		if (threadCount == 0)
 		{
-			throw std::runtime_error( "failed to create pipeline layout!" );
+			return;
 		}
 
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = shaderStages;
-		pipelineInfo.pVertexInputState = &vertexInputInfo;
-		pipelineInfo.pInputAssemblyState = &inputAssembly;
-		pipelineInfo.pViewportState = &viewportState;
-		pipelineInfo.pRasterizationState = &rasterizer;
-		pipelineInfo.pMultisampleState = &multisampling;
-		pipelineInfo.pColorBlendState = &colorBlending;
-		pipelineInfo.pDynamicState = &dynamicState;
-		pipelineInfo.layout = pipelineLayout;
-		pipelineInfo.renderPass = renderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		QueueFamilyIndices queueFamilyIndices = findQueueFamilies( physicalDevice );
+		workerCommandPools.resize( maxFramesInFlight * threadCount );
+		workerCommandBuffers.resize( maxFramesInFlight * threadCount );
 
-		if (vkCreateGraphicsPipelines( device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline ) != VK_SUCCESS)
+		for (size_t i = 0; i < workerCommandPools.size(); i++)
 		{
-			throw std::runtime_error( "failed to create graphics pipeline!" );
+			VkCommandPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+			if (vkCreateCommandPool( device, &poolInfo, nullptr, &workerCommandPools[i] ) != VK_SUCCESS)
+			{
+				throw std::runtime_error( "failed to create worker command pool!" );
+			}
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = workerCommandPools[i];
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandBufferCount = 1;
+
+			if (vkAllocateCommandBuffers( device, &allocInfo, &workerCommandBuffers[i] ) != VK_SUCCESS)
+			{
+				throw std::runtime_error( "failed to allocate secondary command buffer!" );
+			}
 		}
 
-		vkDestroyShaderModule( device, fragShaderModule, nullptr );
-		vkDestroyShaderModule( device, vertShaderModule, nullptr );
+		recordWorkers.start( threadCount );
 	}
 
-	void createFramebuffers()
+	void createTimestampQueryPool()
 	{
-		swapChainFramebuffers.resize( swapChainImageViews.size() );
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties( physicalDevice, &properties );
 
-		for (size_t i = 0; i < swapChainImageViews.size(); i++)
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties( physicalDevice, &queueFamilyCount, nullptr );
+		std::vector<VkQueueFamilyProperties> queueFamilies( queueFamilyCount );
+		vkGetPhysicalDeviceQueueFamilyProperties( physicalDevice, &queueFamilyCount, queueFamilies.data() );
+
+		//timestampValidBits为0表示该队列族不支持时间戳
+		uint32_t validBits = queueFamilies[findQueueFamilies( physicalDevice ).graphicsFamily.value()].timestampValidBits;
+		if (validBits == 0)
 		{
-			VkImageView attachments[] = {
-				swapChainImageViews[i]//来自交换链
-			};
+			std::cout << "timestamp queries not supported on the graphics queue, GPU timings disabled" << std::endl;
+			return;
+		}
 
-			VkFramebufferCreateInfo framebufferInfo{};
-			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			framebufferInfo.renderPass = renderPass;//只能将帧缓冲与它兼容的渲染通道一起使用！
-			framebufferInfo.attachmentCount = 1;
-			framebufferInfo.pAttachments = attachments;
-			framebufferInfo.width = swapChainExtent.width;
-			framebufferInfo.height = swapChainExtent.height;
-			framebufferInfo.layers = 1;
+		timestampsSupported = true;
+		cullTimestampsSupported = !asyncComputeEnabled() || queueFamilies[computeFamily].timestampValidBits != 0;
+		timestampPeriod = properties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? ~0ULL : ((1ULL << validBits) - 1);
+		timestampFrames.assign( maxFramesInFlight, UINT64_MAX );
 
-			if (vkCreateFramebuffer( device, &framebufferInfo, nullptr, &swapChainFramebuffers[i] ) != VK_SUCCESS)
-			{
-				throw std::runtime_error( "failed to create framebuffer!" );
-			}
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = maxFramesInFlight * TIMESTAMPS_PER_FRAME;
+
+		if (vkCreateQueryPool( device, &queryPoolInfo, nullptr, &timestampQueryPool ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to create timestamp query pool!" );
 		}
 	}
 
-	void createCommandPool()
+	//读取槽位上一次使用时写入的时间戳。调用前该槽位的栅栏必须已经发出信号，
+	//所以结果一定可用，不需要VK_QUERY_RESULT_WAIT_BIT，也不会阻塞
+	void collectTimestamps( uint32_t frameSlot )
 	{
-		QueueFamilyIndices queueFamilyIndices = findQueueFamilies( physicalDevice );
+		if (!timestampsSupported || timestampFrames[frameSlot] == UINT64_MAX)
+		{
+			return;
+		}
 
-		VkCommandPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();//命令池绑定一个队列族
+		uint64_t frameIndex = timestampFrames[frameSlot];
+		timestampFrames[frameSlot] = UINT64_MAX;
 
-		if (vkCreateCommandPool( device, &poolInfo, nullptr, &commandPool ) != VK_SUCCESS)
+		uint64_t timestamps[TIMESTAMPS_PER_FRAME];
+		VkResult result = vkGetQueryPoolResults( device, timestampQueryPool, frameSlot * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME,
+			sizeof( timestamps ), timestamps, sizeof( uint64_t ), VK_QUERY_RESULT_64_BIT );
+		if (result != VK_SUCCESS)
 		{
-			throw std::runtime_error( "failed to create command pool!" );
+			return;
+		}
+
+		//只有预热之后记录下来的帧才需要GPU耗时
+		if (frameIndex < config.warmupFrames || frameIndex - config.warmupFrames >= frameTimings.size())
+		{
+			return;
 		}
+
+		auto toMs = [this]( uint64_t begin, uint64_t end )
+		{
+			return static_cast<double>((end - begin) & timestampMask) * timestampPeriod / 1000000.0;
+		};
+		FrameTimings& timings = frameTimings[frameIndex - config.warmupFrames];
+		timings.gpuRenderPass = toMs( timestamps[TIMESTAMP_PASS_BEGIN], timestamps[TIMESTAMP_PASS_END] );
+		timings.gpuDraw = toMs( timestamps[TIMESTAMP_DRAW_BEGIN], timestamps[TIMESTAMP_DRAW_END] );
+		timings.gpuCull = toMs( timestamps[TIMESTAMP_CULL_BEGIN], timestamps[TIMESTAMP_CULL_END] );
 	}
 
-	void createCommandBuffers()
+	void writeTimestamp( VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, TimestampQuery query )
 	{
-		commandBuffers.resize( MAX_FRAMES_IN_FLIGHT );
-
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = commandPool;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+		if (timestampsSupported)
+		{
+			vkCmdWriteTimestamp( commandBuffer, stage, timestampQueryPool, currentFrame * TIMESTAMPS_PER_FRAME + query );
+		}
+	}
 
-		if (vkAllocateCommandBuffers( device, &allocInfo, commandBuffers.data() ) != VK_SUCCESS)
+	//每帧的pass和它们使用的资源。交换链图像不保留旧内容，从获取信号量等待的阶段开始；
+	//结束时转换到呈现（headless模式为回读）需要的布局
+	void buildRenderGraphs()
+	{
+		backbufferResource = frameGraph.importImage( "backbuffer", VK_IMAGE_ASPECT_COLOR_BIT,
+			{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED } );
+		frameGraph.setOutput( backbufferResource, config.headless
+			? RenderGraphAccess{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL }
+			: RenderGraphAccess{ VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR } );
+
+		std::vector<RenderGraph::Use> sceneReads;
+		if (config.drawMode == DrawMode::Indirect)
 		{
-			throw std::runtime_error( "failed to allocate command buffers!" );
+			//该槽位上一次的间接绘制已经完成（waitForFrameSlot），区域不需要等待
+			RenderGraph& cullGraph = asyncComputeEnabled() ? computeGraph : frameGraph;
+			RenderGraph::ResourceId drawCommands = cullGraph.importBuffer( "draw_commands", {} );
+			cullGraph.addPass( "clear_draw_count", {},
+				{ { drawCommands, { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT } } },
+				[this]( VkCommandBuffer commandBuffer ) { recordDrawCountClear( commandBuffer ); } );
+			cullGraph.addPass( "cull", {},
+				{ { drawCommands, { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT } } },
+				[this]( VkCommandBuffer commandBuffer ) { recordCullDispatch( commandBuffer ); } );
+
+			if (asyncComputeEnabled())
+			{
+				//交给图形队列，由computeTimeline同步，两个图里都不需要屏障
+				computeGraph.setOutput( drawCommands, {} );
+				computeDrawCommandsResource = drawCommands;
+				drawCommands = frameGraph.importBuffer( "draw_commands", {} );
+			}
+			drawCommandsResource = drawCommands;
+			sceneReads.push_back( { drawCommands, { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT } } );
 		}
+
+		frameGraph.addPass( "scene", sceneReads,
+			{ { backbufferResource, { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL } } },
+			[this]( VkCommandBuffer commandBuffer ) { recordScenePass( commandBuffer ); } );
+
+		frameGraph.compile( device, allocator );
+		computeGraph.compile( device, allocator );
 	}
 
 	//把要执行的命令写入命令缓冲区
@@ -701,21 +6430,114 @@ private:
 		{
 			throw std::runtime_error( "failed to begin recording command buffer!" );
 		}
+		//查询在使用前必须在渲染通道外重置
+		if (timestampsSupported)
+		{
+			bool computeResetsCull = asyncComputeEnabled() && cullTimestampsSupported;
+			vkCmdResetQueryPool( commandBuffer, timestampQueryPool, currentFrame * TIMESTAMPS_PER_FRAME,
+				computeResetsCull ? TIMESTAMP_CULL_BEGIN : TIMESTAMPS_PER_FRAME );
+			timestampFrames[currentFrame] = frameCounter;
+		}
+		recordUploadAcquires( commandBuffer );
+		recordTextureUploads( commandBuffer );
+		//没有剔除pass（非间接模式）或计算队列族不支持时间戳时，写两个相邻的时间戳让查询可读，剔除耗时记为0
+		if (config.drawMode != DrawMode::Indirect || !cullTimestampsSupported)
+		{
+			writeTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_CULL_BEGIN );
+			writeTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_CULL_END );
+		}
+
+		frameImageIndex = imageIndex;
+		frameGraph.setImage( backbufferResource, swapChainImages[imageIndex] );
+		if (config.drawMode == DrawMode::Indirect)
+		{
+			frameGraph.setBuffer( drawCommandsResource, drawCommandBuffer, drawCommandRegionSize * currentFrame, drawCommandRegionSize );
+		}
+		frameGraph.execute( commandBuffer );
+
+		if (vkEndCommandBuffer( commandBuffer ) != VK_SUCCESS)
+		{
+			throw std::runtime_error( "failed to record command buffer!" );
+		}
+	}
+
+	//场景pass：清屏并绘制所有对象。渲染通道前后的布局转换由渲染图完成
+	void recordScenePass( VkCommandBuffer commandBuffer )
+	{
+		writeTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_PASS_BEGIN );
+		//开始写入命令缓冲区（用于写入的函数以vkCmd开头）
+		if (workerCommandBuffers.empty())
+		{
+			beginSceneRendering( commandBuffer, false );
+			writeTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_DRAW_BEGIN );
+			recordDraws( commandBuffer, 0, scene.objects.size() );
+			writeTimestamp( commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_DRAW_END );
+		}
+		else
+		{
+			//渲染通道的内容全部来自二级命令缓冲区
+			beginSceneRendering( commandBuffer, true );
+			recordSecondaryCommandBuffers( frameImageIndex );
+			uint32_t threadCount = recordWorkers.size();
+			vkCmdExecuteCommands( commandBuffer, threadCount, &workerCommandBuffers[currentFrame * threadCount] );
+		}
+
+		if (config.dynamicRendering)
+		{
+			vkCmdEndRendering( commandBuffer );
+		}
+		else
+		{
+			vkCmdEndRenderPass( commandBuffer );
+		}
+		writeTimestamp( commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_PASS_END );
+	}
+
+	//清屏并开始渲染到当前交换链图像：渲染通道路径使用renderPass和帧缓冲，动态渲染路径直接使用image view
+	void beginSceneRendering( VkCommandBuffer commandBuffer, bool secondaryContents )
+	{
+		VkClearValue clearColor = { {{0.5f, 0.5f, 0.5f, 1.0f}} };
+
+		if (config.dynamicRendering)
+		{
+			VkRenderingAttachmentInfo colorAttachment{};
+			colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+			colorAttachment.imageView = swapChainImageViews[frameImageIndex];
+			colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;//由渲染图转换
+			colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			colorAttachment.clearValue = clearColor;
+
+			VkRenderingInfo renderingInfo{};
+			renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+			renderingInfo.flags = secondaryContents ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+			renderingInfo.renderArea.offset = { 0, 0 };
+			renderingInfo.renderArea.extent = swapChainExtent;
+			renderingInfo.layerCount = 1;
+			renderingInfo.colorAttachmentCount = 1;
+			renderingInfo.pColorAttachments = &colorAttachment;
+
+			vkCmdBeginRendering( commandBuffer, &renderingInfo );
+			return;
+		}
+
 		//渲染通道的详细信息
 		VkRenderPassBeginInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 		renderPassInfo.renderPass = renderPass;
-		renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+		renderPassInfo.framebuffer = swapChainFramebuffers[frameImageIndex];
 		renderPassInfo.renderArea.offset = { 0, 0 };
 		renderPassInfo.renderArea.extent = swapChainExtent;
-
-		VkClearValue clearColor = { {{0.5f, 0.5f, 0.5f, 1.0f}} };
 		renderPassInfo.clearValueCount = 1;
 		renderPassInfo.pClearValues = &clearColor;
-		//开始写入命令缓冲区（用于写入的函数以vkCmd开头）
-		vkCmdBeginRenderPass( commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE );
 
-		vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline );
+		vkCmdBeginRenderPass( commandBuffer, &renderPassInfo, secondaryContents ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE );
+	}
+
+	//绘制场景对象[firstObject, lastObject)，主命令缓冲区和二级命令缓冲区共用
+	void recordDraws( VkCommandBuffer commandBuffer, size_t firstObject, size_t lastObject )
+	{
+		vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, activePipeline );
 		//动态状态的视口和裁剪矩形在此处设置
 		VkViewport viewport{};
 		viewport.x = 0.0f;
@@ -731,21 +6553,214 @@ private:
 		scissor.extent = swapChainExtent;
 		vkCmdSetScissor( commandBuffer, 0, 1, &scissor );
 
-		vkCmdDraw( commandBuffer, 3, 1, 0, 0 );//显示发出一个draw call
+		//实例化和间接绘制共用每实例顶点数据，间接绘制在下面分支
+		if (config.drawMode != DrawMode::PerObject)
+		{
+			//instanced.vert不读取binding 1，但动态偏移仍然必须提供
+			uint32_t dynamicOffsets[] = {
+				static_cast<uint32_t>(frameConstantsOffset),
+				static_cast<uint32_t>(frameConstantsOffset)
+			};
+			vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 2, dynamicOffsets );
 
-		vkCmdEndRenderPass( commandBuffer );
+			VkBuffer vertexBuffers[] = { vertexBuffer, uploadRing.getBuffer() };
+			VkDeviceSize offsets[] = { 0, instanceDataOffset };
+			vkCmdBindVertexBuffers( commandBuffer, 0, 2, vertexBuffers, offsets );
+			vkCmdBindIndexBuffer( commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32 );
 
-		if (vkEndCommandBuffer( commandBuffer ) != VK_SUCCESS)
+			//剔除结果只有一份，由负责第一个对象的命令缓冲区绘制
+			if (config.drawMode == DrawMode::Indirect)
+			{
+				if (firstObject == 0 && lastObject > 0)
+				{
+					recordIndirectDraw( commandBuffer );
+				}
+				return;
+			}
+
+			//一次绘制这一段的全部实例，firstInstance决定从哪个实例数据开始读
+			if (lastObject > firstObject)
+			{
+				vkCmdDrawIndexed( commandBuffer, static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(lastObject - firstObject), 0, 0, static_cast<uint32_t>(firstObject) );
+			}
+			return;
+		}
+
+		VkBuffer vertexBuffers[] = { vertexBuffer };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers( commandBuffer, 0, 1, vertexBuffers, offsets );
+		vkCmdBindIndexBuffer( commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32 );
+
+		//bindless模式：两个集合都只绑定一次，每次绘制只推送对象常量在bindless缓冲区中的位置
+		if (bindlessEnabled())
 		{
-			throw std::runtime_error( "failed to record command buffer!" );
+			uint32_t dynamicOffsets[] = {
+				static_cast<uint32_t>(frameConstantsOffset),
+				static_cast<uint32_t>(frameConstantsOffset)
+			};
+			VkDescriptorSet sets[] = { descriptorSet, bindlessSet };
+			vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 2, sets, 2, dynamicOffsets );
+
+			const uint32_t objectVec4s = sizeof( ObjectConstants ) / 16;
+			BindlessDrawConstants drawConstants{};
+			drawConstants.objectBuffer = objectBufferIndex;
+			//和描述符模式一样，材质纹理就绪之前采样占位纹理
+			drawConstants.texture = textures[materialTexture].resident ? textures[materialTexture].bindlessIndex : textures[0].bindlessIndex;
+			for (size_t i = firstObject; i < lastObject; i++)
+			{
+				drawConstants.objectOffset = static_cast<uint32_t>(objectConstantsOffset / 16 + objectVec4s * i);
+				vkCmdPushConstants( commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof( BindlessDrawConstants ), &drawConstants );
+				vkCmdDrawIndexed( commandBuffer, static_cast<uint32_t>(mesh.indices.size()), 1, 0, 0, 0 );
+			}
+			return;
+		}
+
+		//push constant模式：描述符集只绑定一次，每次绘制只推送该对象的常量
+		if (config.objectPushConstants)
+		{
+			uint32_t dynamicOffsets[] = {
+				static_cast<uint32_t>(frameConstantsOffset),
+				static_cast<uint32_t>(frameConstantsOffset)
+			};
+			vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 2, dynamicOffsets );
+			for (size_t i = firstObject; i < lastObject; i++)
+			{
+				vkCmdPushConstants( commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof( ObjectConstants ), &objectConstants[i] );
+				vkCmdDrawIndexed( commandBuffer, static_cast<uint32_t>(mesh.indices.size()), 1, 0, 0, 0 );
+			}
+			return;
+		}
+
+		//每个对象一次绘制，通过动态偏移选择它在uploadRing中的常量
+		for (size_t i = firstObject; i < lastObject; i++)
+		{
+			uint32_t dynamicOffsets[] = {
+				static_cast<uint32_t>(frameConstantsOffset),
+				static_cast<uint32_t>(objectConstantsOffset + objectConstantsStride * i)
+			};
+			vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 2, dynamicOffsets );
+			vkCmdDrawIndexed( commandBuffer, static_cast<uint32_t>(mesh.indices.size()), 1, 0, 0, 0 );
+		}
+	}
+
+	void recordIndirectDraw( VkCommandBuffer commandBuffer )
+	{
+		VkDeviceSize regionOffset = drawCommandRegionSize * currentFrame;
+		uint32_t maxDrawCount = static_cast<uint32_t>(scene.objects.size());
+		if (drawIndirectCountSupported)
+		{
+			vkCmdDrawIndexedIndirectCount( commandBuffer, drawCommandBuffer, regionOffset + DRAW_COMMANDS_OFFSET, drawCommandBuffer, regionOffset,
+				maxDrawCount, sizeof( VkDrawIndexedIndirectCommand ) );
+		}
+		else
+		{
+			//没有count时执行全部命令，被剔除的对象instanceCount为0
+			vkCmdDrawIndexedIndirect( commandBuffer, drawCommandBuffer, regionOffset + DRAW_COMMANDS_OFFSET, maxDrawCount, sizeof( VkDrawIndexedIndirectCommand ) );
+		}
+	}
+
+	//在渲染通道之前：清零可见数量，运行剔除着色器，再让间接绘制读取它的输出
+	//剔除的两个pass录制在图形命令缓冲区或异步计算命令缓冲区中，之间和之后的屏障由渲染图生成
+	void recordDrawCountClear( VkCommandBuffer commandBuffer )
+	{
+		writeCullTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_CULL_BEGIN );
+		vkCmdFillBuffer( commandBuffer, drawCommandBuffer, drawCommandRegionSize * currentFrame, sizeof( uint32_t ), 0 );
+	}
+
+	void recordCullDispatch( VkCommandBuffer commandBuffer )
+	{
+		VkDeviceSize regionOffset = drawCommandRegionSize * currentFrame;
+		CullConstants constants{};
+		extractFrustumPlanes( viewProj, constants.frustumPlanes );
+		constants.objectCount = static_cast<uint32_t>(scene.objects.size());
+		constants.indexCount = static_cast<uint32_t>(mesh.indices.size());
+		constants.boundingRadius = meshBoundingRadius;
+		constants.compact = drawIndirectCountSupported ? 1 : 0;
+
+		uint32_t dynamicOffsets[] = {
+			static_cast<uint32_t>(instanceDataOffset),
+			static_cast<uint32_t>(regionOffset)
+		};
+		vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline );
+		vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSet, 2, dynamicOffsets );
+		vkCmdPushConstants( commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof( CullConstants ), &constants );
+		vkCmdDispatch( commandBuffer, (constants.objectCount + 63) / 64, 1, 1 );//cull.comp的local_size_x为64
+
+		writeCullTimestamp( commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, TIMESTAMP_CULL_END );
+	}
+
+	void writeCullTimestamp( VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, TimestampQuery query )
+	{
+		if (cullTimestampsSupported)
+		{
+			writeTimestamp( commandBuffer, stage, query );
 		}
 	}
 
+	//每个工作线程录制绘制列表的一段，时间戳写在第一段的开头和最后一段的末尾
+	void recordSecondaryCommandBuffers( uint32_t imageIndex )
+	{
+		uint32_t threadCount = recordWorkers.size();
+		size_t objectCount = scene.objects.size();
+
+		recordWorkers.dispatch( [&]( uint32_t worker )
+			{
+				VkCommandPool pool = workerCommandPools[currentFrame * threadCount + worker];
+				VkCommandBuffer commandBuffer = workerCommandBuffers[currentFrame * threadCount + worker];
+				vkResetCommandPool( device, pool, 0 );//该帧的栅栏已经等待过，池中的命令缓冲区不再被GPU使用
+
+				//动态渲染路径没有渲染通道和帧缓冲，继承的是附件格式
+				VkCommandBufferInheritanceRenderingInfo renderingInheritance{};
+				renderingInheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+				renderingInheritance.colorAttachmentCount = 1;
+				renderingInheritance.pColorAttachmentFormats = &swapChainImageFormat;
+				renderingInheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+				VkCommandBufferInheritanceInfo inheritanceInfo{};
+				inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+				if (config.dynamicRendering)
+				{
+					inheritanceInfo.pNext = &renderingInheritance;
+				}
+				else
+				{
+					inheritanceInfo.renderPass = renderPass;
+					inheritanceInfo.subpass = 0;
+					inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+				}
+
+				VkCommandBufferBeginInfo beginInfo{};
+				beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+				beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+				beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+				if (vkBeginCommandBuffer( commandBuffer, &beginInfo ) != VK_SUCCESS)
+				{
+					throw std::runtime_error( "failed to begin recording secondary command buffer!" );
+				}
+
+				if (worker == 0)
+				{
+					writeTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TIMESTAMP_DRAW_BEGIN );
+				}
+				recordDraws( commandBuffer, objectCount * worker / threadCount, objectCount * (worker + 1) / threadCount );
+				if (worker == threadCount - 1)
+				{
+					writeTimestamp( commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TIMESTAMP_DRAW_END );
+				}
+
+				if (vkEndCommandBuffer( commandBuffer ) != VK_SUCCESS)
+				{
+					throw std::runtime_error( "failed to record secondary command buffer!" );
+				}
+			} );
+	}
+
 	void createSyncObjects()
 	{
-		imageAvailableSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
-		renderFinishedSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
-		inFlightFences.resize( MAX_FRAMES_IN_FLIGHT );
+		imageAvailableSemaphores.resize( maxFramesInFlight );
+		renderFinishedSemaphores.resize( maxFramesInFlight );
+		inFlightFences.assign( maxFramesInFlight, VK_NULL_HANDLE );
 
 		VkSemaphoreCreateInfo semaphoreInfo{};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -754,66 +6769,227 @@ private:
 		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;//创建处于已发出信号状态的信号量，确保第一帧能绘制
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		for (size_t i = 0; i < maxFramesInFlight; i++)
 		{
+			//交换链的获取和呈现只支持二值信号量，时间线模式下也需要它们
 			if (vkCreateSemaphore( device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i] ) != VK_SUCCESS ||
 				 vkCreateSemaphore( device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i] ) != VK_SUCCESS ||
-				 vkCreateFence( device, &fenceInfo, nullptr, &inFlightFences[i] ) != VK_SUCCESS)
+				 (config.syncMode == SyncMode::Fence && vkCreateFence( device, &fenceInfo, nullptr, &inFlightFences[i] ) != VK_SUCCESS))
 			{
 
 				throw std::runtime_error( "failed to create synchronization objects for a frame!" );
 			}
 		}
+
+		if (config.syncMode == SyncMode::Timeline)
+		{
+			VkSemaphoreTypeCreateInfo timelineInfo{};
+			timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			timelineInfo.initialValue = 0;
+
+			VkSemaphoreCreateInfo timelineSemaphoreInfo{};
+			timelineSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			timelineSemaphoreInfo.pNext = &timelineInfo;
+
+			if (vkCreateSemaphore( device, &timelineSemaphoreInfo, nullptr, &graphicsTimeline ) != VK_SUCCESS)
+			{
+				throw std::runtime_error( "failed to create timeline semaphore!" );
+			}
+		}
+	}
+
+	//CPU等待任意已提交的帧完成。时间线模式下等待计数器达到frameIndex + 1；
+	//栅栏模式下等待该帧槽位的栅栏，槽位已被更晚的帧复用时，等到的是更晚的帧，同样说明frameIndex已完成
+	void waitForFrame( uint64_t frameIndex )
+	{
+		if (frameIndex >= frameCounter)
+		{
+			throw std::runtime_error( "cannot wait for a frame that has not been submitted!" );
+		}
+
+		if (config.syncMode == SyncMode::Timeline)
+		{
+			uint64_t value = frameIndex + 1;
+			VkSemaphoreWaitInfo waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &graphicsTimeline;
+			waitInfo.pValues = &value;
+			vkWaitSemaphores( device, &waitInfo, UINT64_MAX );
+			return;
+		}
+
+		vkWaitForFences( device, 1, &inFlightFences[frameIndex % maxFramesInFlight], VK_TRUE, UINT64_MAX );
+	}
+
+	//等待上一次使用currentFrame槽位的帧完成，之后该槽位的命令缓冲区、上传区域和查询都可以复用
+	void waitForFrameSlot()
+	{
+		if (config.syncMode == SyncMode::Fence)
+		{
+			vkWaitForFences( device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX );
+		}
+		else if (frameCounter >= maxFramesInFlight)
+		{
+			waitForFrame( frameCounter - maxFramesInFlight );
+		}
 	}
 
 	void drawFrame()
 	{
-		vkWaitForFences( device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX );
+		typedef std::chrono::steady_clock Clock;
+		auto elapsedMs = []( Clock::time_point from, Clock::time_point to )
+		{
+			return std::chrono::duration<double, std::milli>( to - from ).count();
+		};
+		FrameTimings timings;
+		auto frameStart = Clock::now();
 
-		uint32_t imageIndex;
-		VkResult result = vkAcquireNextImageKHR( device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex );
+		waitForFrameSlot();
 
-		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		auto fenceDone = Clock::now();
+		timings.fenceWait = elapsedMs( frameStart, fenceDone );
+
+		//该槽位的栅栏已发出信号，maxFramesInFlight帧之前写入的时间戳可以直接读取
+		collectTimestamps( currentFrame );
+		allocator.beginFrame( currentFrame );
+		frameDescriptors.beginFrame( currentFrame );
+		flushDeletionQueue();
+
+		auto acquireStart = Clock::now();
+
+		uint32_t imageIndex;
+		VkResult result = VK_SUCCESS;
+		if (config.headless)
 		{
-			recreateSwapChain();
-			return;
+			imageIndex = currentFrame;//离屏图像与帧一一对应，等待栅栏后即可安全复用
+		}
+		else
+		{
+			result = vkAcquireNextImageKHR( device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex );
+
+			if (result == VK_ERROR_OUT_OF_DATE_KHR)
+			{
+				recreateSwapChain();
+				return;
+			}
+			else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+			{
+				throw std::runtime_error( "failed to acquire swap chain image!" );
+			}
+			releaseRetiredSwapChains( imageIndex );
 		}
-		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+
+		auto acquireDone = Clock::now();
+		timings.acquire = elapsedMs( acquireStart, acquireDone );
+
+		if (config.syncMode == SyncMode::Fence)
 		{
-			throw std::runtime_error( "failed to acquire swap chain image!" );
+			vkResetFences( device, 1, &inFlightFences[currentFrame] );//注意顺序，防止死锁
 		}
 
-		vkResetFences( device, 1, &inFlightFences[currentFrame] );//注意顺序，防止死锁
+		updateFrameData();
+		allocateFrameDescriptorSets();
+		applyShaderReloads();
+		selectFramePipeline();
+		if (asyncComputeEnabled())
+		{
+			submitCompute();//先于本帧的图形提交，和仍在执行的上一帧图形工作重叠
+		}
 
 		vkResetCommandBuffer( commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0 );
 		recordCommandBuffer( commandBuffers[currentFrame], imageIndex );
 
+		auto recordDone = Clock::now();
+		timings.record = elapsedMs( acquireDone, recordDone );
+
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.pWaitDstStageMask = waitStages;
+		//headless模式没有获取/呈现操作，不需要二值信号量；有异步上传时还要等待传输队列完成，异步计算时等待本帧的剔除
+		std::array<VkSemaphore, 3> waitSemaphores{};
+		std::array<VkPipelineStageFlags, 3> waitStages{};
+		std::array<uint64_t, 3> waitValues{};
+		uint32_t waitCount = 0;
+		if (!config.headless)
+		{
+			waitStages[waitCount] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			waitSemaphores[waitCount++] = imageAvailableSemaphores[currentFrame];
+		}
+		if (frameUploadWaitValue != 0)
+		{
+			waitStages[waitCount] = frameUploadWaitStages;
+			waitValues[waitCount] = frameUploadWaitValue;
+			waitSemaphores[waitCount++] = transferTimeline;
+		}
+		if (asyncComputeEnabled())
+		{
+			waitStages[waitCount] = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+			waitValues[waitCount] = frameCounter + 1;
+			waitSemaphores[waitCount++] = computeTimeline;
+		}
+		submitInfo.waitSemaphoreCount = waitCount;
+		submitInfo.pWaitSemaphores = waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = waitStages.data();
 
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
-		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = signalSemaphores;
+		//时间线模式额外发出graphicsTimeline = frameCounter + 1，二值信号量对应的值会被忽略
+		std::array<VkSemaphore, 2> signalSemaphores{};
+		std::array<uint64_t, 2> signalValues{};
+		uint32_t signalCount = 0;
+		if (!config.headless)
+		{
+			signalSemaphores[signalCount++] = renderFinishedSemaphores[currentFrame];
+		}
+		if (config.syncMode == SyncMode::Timeline)
+		{
+			signalValues[signalCount] = frameCounter + 1;
+			signalSemaphores[signalCount++] = graphicsTimeline;
+		}
+		submitInfo.signalSemaphoreCount = signalCount;
+		submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineSubmitInfo.waitSemaphoreValueCount = waitCount;
+		timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+		timelineSubmitInfo.signalSemaphoreValueCount = signalCount;
+		timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+		if (config.syncMode == SyncMode::Timeline || frameUploadWaitValue != 0 || asyncComputeEnabled())
+		{
+			submitInfo.pNext = &timelineSubmitInfo;
+		}
 
 		if (vkQueueSubmit( graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame] ) != VK_SUCCESS)
 		{
 			throw std::runtime_error( "failed to submit draw command buffer!" );
 		}
 
+		//获取所有权的帧完成后，传输命令缓冲区和暂存缓冲区才能回收
+		for (PendingAcquire& acquire : frameAcquires)
+		{
+			deletionQueue.push( frameCounter, std::move( acquire.release ) );
+		}
+		frameAcquires.clear();
+
+		auto submitDone = Clock::now();
+		timings.submit = elapsedMs( recordDone, submitDone );
+
+		if (config.headless)
+		{
+			timings.total = elapsedMs( frameStart, submitDone );
+			finishFrame( timings );
+			return;
+		}
+
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
 		presentInfo.waitSemaphoreCount = 1;
-		presentInfo.pWaitSemaphores = signalSemaphores;
+		presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
 
 		VkSwapchainKHR swapChains[] = { swapChain };
 		presentInfo.swapchainCount = 1;
@@ -822,6 +6998,15 @@ private:
 		presentInfo.pImageIndices = &imageIndex;
 
 		result = vkQueuePresentKHR( presentQueue, &presentInfo );
+		if ((result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) && !retiredSwapChains.empty() && !retireMarkerImage)
+		{
+			retireMarkerImage = imageIndex;//新交换链上的第一次呈现
+		}
+
+		auto presentDone = Clock::now();
+		timings.present = elapsedMs( submitDone, presentDone );
+		timings.inputToPresent = elapsedMs( inputSampleTime, presentDone );
+		timings.total = elapsedMs( frameStart, presentDone );
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
 		{
@@ -833,16 +7018,36 @@ private:
 			throw std::runtime_error( "failed to present swap chain image!" );
 		}
 
-		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		finishFrame( timings );
+	}
+
+	//记录本帧耗时并推进到下一帧
+	void finishFrame( const FrameTimings& timings )
+	{
+		if (frameCounter == 0)
+		{
+			timeToFirstFrameMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - startupBegin ).count();
+			std::cout << "startup (" << (pipelineCacheWarm ? "warm" : "cold") << " pipeline cache): "
+				<< pipelineCount << " pipelines in " << pipelineCreationMs << " ms, first frame after "
+				<< timeToFirstFrameMs << " ms" << std::endl;
+		}
+
+		if (config.benchmarkFrames > 0 && frameCounter >= config.warmupFrames)
+		{
+			frameTimings.push_back( timings );
+		}
+
+		frameCounter++;
+		currentFrame = (currentFrame + 1) % maxFramesInFlight;
 	}
 
-	VkShaderModule createShaderModule( const std::vector<char>& code )
+	//code直接指向文件映射或归档映射，二者都至少4字节对齐
+	VkShaderModule createShaderModule( const char* code, size_t size )
 	{
 		VkShaderModuleCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = code.size();
-		//数据存储在 std::vector 中，其中默认分配器已经确保数据满足最坏情况下的对齐要求
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+		createInfo.codeSize = size;
+		createInfo.pCode = reinterpret_cast<const uint32_t*>(code);
 
 		VkShaderModule shaderModule;//shader module句柄
 		if (vkCreateShaderModule( device, &createInfo, nullptr, &shaderModule ) != VK_SUCCESS)
@@ -871,11 +7076,11 @@ private:
 	//vsync
 	VkPresentModeKHR chooseSwapPresentMode( const std::vector<VkPresentModeKHR>& availablePresentModes )
 	{
-		for (const auto& availablePresentMode : availablePresentModes)
+		for (VkPresentModeKHR preferredMode : pacingPolicy.presentModes)
 		{
-			if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+			if (std::find( availablePresentModes.begin(), availablePresentModes.end(), preferredMode ) != availablePresentModes.end())
 			{
-				return availablePresentMode;
+				return preferredMode;
 			}
 		}
 
@@ -943,6 +7148,12 @@ private:
 
 		bool extensionsSupported = checkDeviceExtensionSupport( device );
 
+		//headless模式只需要图形队列，不检查呈现和交换链支持（lavapipe等软件ICD也可用）
+		if (config.headless)
+		{
+			return indices.isComplete( false ) && extensionsSupported;
+		}
+
 		bool swapChainAdequate = false;
 		if (extensionsSupported)
 		{
@@ -963,6 +7174,7 @@ private:
 		std::vector<VkExtensionProperties> availableExtensions( extensionCount );
 		vkEnumerateDeviceExtensionProperties( device, nullptr, &extensionCount, availableExtensions.data() );
 
+		auto deviceExtensions = getRequiredDeviceExtensions();
 		std::set<std::string> requiredExtensions( deviceExtensions.begin(), deviceExtensions.end() );
 
 		for (const auto& extension : availableExtensions)
@@ -986,22 +7198,25 @@ private:
 		int i = 0;
 		for (const auto& queueFamily : queueFamilies)
 		{
-			//判断队列族是否支持绘图命令
-			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			//判断队列族是否支持绘图命令（剔除用的计算着色器也在同一个队列上执行）
+			if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))
 			{
 				indices.graphicsFamily = i;
 			}
 
 			VkBool32 presentSupport = false;
 			//查找队列族索引i对应的队列族是否具有向窗口表面呈现能力
-			vkGetPhysicalDeviceSurfaceSupportKHR( device, i, surface, &presentSupport );
+			if (surface != VK_NULL_HANDLE)
+			{
+				vkGetPhysicalDeviceSurfaceSupportKHR( device, i, surface, &presentSupport );
+			}
 
 			if (presentSupport)
 			{
 				indices.presentFamily = i;
 			}
 
-			if (indices.isComplete())
+			if (indices.isComplete( !config.headless ))
 			{
 				break;
 			}
@@ -1009,16 +7224,42 @@ private:
 			i++;
 		}
 
+		//专用传输队列族：支持TRANSFER但不支持GRAPHICS和COMPUTE，一般对应独立的DMA引擎
+		for (uint32_t family = 0; family < queueFamilyCount; family++)
+		{
+			VkQueueFlags flags = queueFamilies[family].queueFlags;
+			if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+			{
+				indices.transferFamily = family;
+				break;
+			}
+		}
+
+		for (uint32_t family = 0; family < queueFamilyCount; family++)
+		{
+			VkQueueFlags flags = queueFamilies[family].queueFlags;
+			if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+			{
+				indices.computeFamily = family;
+				break;
+			}
+		}
+
 		return indices;
 	}
 
 	std::vector<const char*> getRequiredExtensions()
 	{
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions( &glfwExtensionCount );
+		std::vector<const char*> extensions;
+		//headless模式不需要窗口表面相关的扩展
+		if (!config.headless)
+		{
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions;
+			glfwExtensions = glfwGetRequiredInstanceExtensions( &glfwExtensionCount );
 
-		std::vector<const char*> extensions( glfwExtensions, glfwExtensions + glfwExtensionCount );
+			extensions.assign( glfwExtensions, glfwExtensions + glfwExtensionCount );
+		}
 
 		if (enableValidationLayers)
 		{
@@ -1028,6 +7269,16 @@ private:
 		return extensions;
 	}
 
+	std::vector<const char*> getRequiredDeviceExtensions()
+	{
+		if (config.headless)
+		{
+			return {};
+		}
+
+		return deviceExtensions;
+	}
+
 	bool checkValidationLayerSupport()
 	{
 		uint32_t layerCount;
@@ -1058,6 +7309,22 @@ private:
 		return true;
 	}
 
+	//先在资源归档中查找，没有再映射磁盘上的文件。可以在任何线程上调用
+	AssetData loadAsset( const std::string& path )
+	{
+		AssetData asset;
+		if (assetArchive.find( path, asset ))
+		{
+			assetArchiveHits++;
+			return asset;
+		}
+		asset.mapping = std::make_shared<const MappedFile>( path, true );
+		asset.data = asset.mapping->data();
+		asset.size = asset.mapping->size();
+		assetFileMaps++;
+		return asset;
+	}
+
 	static std::vector<char> readFile( const std::string& filename )
 	{
 		std::ifstream file( filename, std::ios::ate | std::ios::binary );
@@ -1087,20 +7354,449 @@ private:
 	}
 };
 
-int main()
+AppConfig parseCommandLine( int argc, char* argv[] )
 {
-	HelloTriangleApplication app;
+	AppConfig config;
 
-	try
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--headless")
+		{
+			config.headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc)
+		{
+			config.frameCount = static_cast<uint32_t>(std::stoul( argv[++i] ));
+		}
+		else if (arg == "--benchmark" && i + 1 < argc)
+		{
+			config.benchmarkFrames = static_cast<uint32_t>(std::stoul( argv[++i] ));
+		}
+		else if (arg == "--warmup" && i + 1 < argc)
+		{
+			config.warmupFrames = static_cast<uint32_t>(std::stoul( argv[++i] ));
+		}
+		else if (arg == "--report" && i + 1 < argc)
+		{
+			config.reportPath = argv[++i];
+		}
+		else if (arg == "--pipeline-cache" && i + 1 < argc)
+		{
+			config.pipelineCachePath = argv[++i];
+		}
+		else if (arg == "--grid" && i + 1 < argc)
+		{
+			config.gridSize = static_cast<uint32_t>(std::stoul( argv[++i] ));
+		}
+		else if (arg == "--threads" && i + 1 < argc)
+		{
+			config.recordThreads = static_cast<uint32_t>(std::stoul( argv[++i] ));
+		}
+		else if (arg == "--thread-sweep" && i + 1 < argc)
+		{
+			config.threadSweepMax = std::max( 1u, static_cast<uint32_t>(std::stoul( argv[++i] )) );
+		}
+		else if (arg == "--draw-mode" && i + 1 < argc)
+		{
+			std::string mode = argv[++i];
+			if (mode == "per-object")
+			{
+				config.drawMode = DrawMode::PerObject;
+			}
+			else if (mode == "instanced")
+			{
+				config.drawMode = DrawMode::Instanced;
+			}
+			else if (mode == "indirect")
+			{
+				config.drawMode = DrawMode::Indirect;
+			}
+			else
+			{
+				throw std::runtime_error( "unknown draw mode: " + mode );
+			}
+		}
+		else if (arg == "--frames-in-flight" && i + 1 < argc)
+		{
+			config.framesInFlight = std::max( 1u, static_cast<uint32_t>(std::stoul( argv[++i] )) );
+		}
+		else if (arg == "--sync" && i + 1 < argc)
+		{
+			std::string mode = argv[++i];
+			if (mode == "fence")
+			{
+				config.syncMode = SyncMode::Fence;
+			}
+			else if (mode == "timeline")
+			{
+				config.syncMode = SyncMode::Timeline;
+			}
+			else
+			{
+				throw std::runtime_error( "unknown sync mode: " + mode );
+			}
+		}
+		else if (arg == "--pacing" && i + 1 < argc)
+		{
+			std::string pacing = argv[++i];
+			if (pacing == "low-latency")
+			{
+				config.pacing = FramePacing::LowLatency;
+			}
+			else if (pacing == "balanced")
+			{
+				config.pacing = FramePacing::Balanced;
+			}
+			else if (pacing == "max-throughput")
+			{
+				config.pacing = FramePacing::MaxThroughput;
+			}
+			else
+			{
+				throw std::runtime_error( "unknown pacing preset: " + pacing );
+			}
+		}
+		else if (arg == "--dynamic-rendering")
+		{
+			config.dynamicRendering = true;
+		}
+		else if (arg == "--render-path-sweep")
+		{
+			config.renderPathSweep = true;
+		}
+		else if (arg == "--self-test")
+		{
+			config.selfTest = true;
+		}
+		else if (arg == "--pacing-sweep")
+		{
+			config.pacingSweep = true;
+		}
+		else if (arg == "--sync-sweep" && i + 1 < argc)
+		{
+			config.syncSweepMax = static_cast<uint32_t>(std::stoul( argv[++i] ));
+		}
+		else if (arg == "--no-async-compute")
+		{
+			config.useAsyncCompute = false;
+		}
+		else if (arg == "--no-transfer-queue")
+		{
+			config.useTransferQueue = false;
+		}
+		else if (arg == "--resize-wait-idle")
+		{
+			config.resizeWaitIdle = true;
+		}
+		else if (arg == "--blend" && i + 1 < argc)
+		{
+			std::string mode = argv[++i];
+			if (mode == "opaque")
+			{
+				config.blendMode = BlendMode::Opaque;
+			}
+			else if (mode == "alpha")
+			{
+				config.blendMode = BlendMode::Alpha;
+			}
+			else if (mode == "additive")
+			{
+				config.blendMode = BlendMode::Additive;
+			}
+			else
+			{
+				throw std::runtime_error( "unknown blend mode: " + mode );
+			}
+		}
+		else if (arg == "--cull-mode" && i + 1 < argc)
+		{
+			std::string mode = argv[++i];
+			if (mode == "back")
+			{
+				config.cullMode = VK_CULL_MODE_BACK_BIT;
+			}
+			else if (mode == "none")
+			{
+				config.cullMode = VK_CULL_MODE_NONE;
+			}
+			else
+			{
+				throw std::runtime_error( "unknown cull mode: " + mode );
+			}
+		}
+		else if (arg == "--pipeline-variant-test" && i + 1 < argc)
+		{
+			config.pipelineVariantInterval = static_cast<uint32_t>(std::stoul( argv[++i] ));
+		}
+		else if (arg == "--sync-pipeline-compile")
+		{
+			config.asyncPipelineCompile = false;
+		}
+		else if (arg == "--no-push-constants")
+		{
+			config.objectPushConstants = false;
+		}
+		else if (arg == "--bindless")
+		{
+			config.bindless = true;
+		}
+		else if (arg == "--texture" && i + 1 < argc)
+		{
+			config.texturePath = argv[++i];
+		}
+		else if (arg == "--assets" && i + 1 < argc)
+		{
+			config.assetArchivePath = argv[++i];
+		}
+		else if (arg == "--pack-assets" && i + 1 < argc)
+		{
+			config.writeAssetArchivePath = argv[++i];
+		}
+		else if (arg == "--no-compressed-textures")
+		{
+			config.compressedTextures = false;
+		}
+		else if (arg == "--hot-reload")
+		{
+			config.shaderHotReload = true;
+		}
+		else if (arg == "--resize-test" && i + 1 < argc)
+		{
+			config.resizeInterval = static_cast<uint32_t>(std::stoul( argv[++i] ));
+		}
+		else if (arg == "--zoom" && i + 1 < argc)
+		{
+			config.cameraZoom = std::stof( argv[++i] );
+		}
+		else if (arg == "--instance-sweep" && i + 1 < argc)
+		{
+			config.instanceSweepMax = std::max( 1u, static_cast<uint32_t>(std::stoul( argv[++i] )) );
+		}
+		else if (arg == "--objects" && i + 1 < argc)
+		{
+			config.objectCount = std::max( 1u, static_cast<uint32_t>(std::stoul( argv[++i] )) );
+		}
+		else
+		{
+			throw std::runtime_error( "unknown argument: " + arg );
+		}
+	}
+
+	return config;
+}
+
+//打包程序会加载的全部资源：图形和计算着色器，以及--texture指定的纹理
+void packAssets( const AppConfig& config )
+{
+	std::vector<std::string> files;
+	for (const ShaderSource& shader : HOT_RELOAD_SHADERS)
+	{
+		files.push_back( shader.output );
+	}
+	files.push_back( "shaders/cull.spv" );
+	if (!config.texturePath.empty())
+	{
+		files.push_back( config.texturePath );
+	}
+	AssetArchive::write( config.writeAssetArchivePath, files );
+	std::cout << "packed " << files.size() << " assets into " << config.writeAssetArchivePath << std::endl;
+}
+
+//依次运行一组benchmark配置，每次写入单独的报告（report_<名称>.json），最后汇总CPU和GPU耗时
+void runBenchmarkSweep( const std::vector<std::pair<std::string, AppConfig>>& runs, const Mesh& mesh )
+{
+	struct SweepResult
 	{
+		std::string name;
+		TimingStats record;
+		TimingStats frame;
+		TimingStats gpuDraw;
+	};
+
+	std::vector<SweepResult> results;
+	for (const auto& [name, config] : runs)
+	{
+		if (config.benchmarkFrames == 0)
+		{
+			throw std::runtime_error( "benchmark sweeps require --benchmark" );
+		}
+
+		AppConfig runConfig = config;
+		std::filesystem::path reportPath( config.reportPath );
+		reportPath.replace_filename( reportPath.stem().string() + "_" + name + reportPath.extension().string() );
+		runConfig.reportPath = reportPath.string();
+
+		Scene scene;
+		scene.mesh = mesh;
+		scene.objects = makeObjectGrid( runConfig.objectCount );
+		HelloTriangleApplication app( runConfig, std::move( scene ) );
 		app.run();
+
+		std::vector<double> record, frame, gpuDraw;
+		for (const FrameTimings& timings : app.getFrameTimings())
+		{
+			record.push_back( timings.record );
+			frame.push_back( timings.total );
+			gpuDraw.push_back( timings.gpuDraw );
+		}
+		results.push_back( { name, computeTimingStats( record ), computeTimingStats( frame ), computeTimingStats( gpuDraw ) } );
+	}
+
+	//speedup相对第一次运行的录制耗时
+	std::cout << "run,record_mean_ms,record_p95_ms,frame_mean_ms,gpu_draw_mean_ms,record_speedup" << std::endl;
+	for (const SweepResult& result : results)
+	{
+		std::cout << result.name << "," << result.record.mean << "," << result.record.p95 << "," << result.frame.mean << ","
+			<< result.gpuDraw.mean << "," << (result.record.mean > 0.0 ? results.front().record.mean / result.record.mean : 0.0) << std::endl;
+	}
+}
+
+//录制线程数：0（主线程直接录制，作为基准），1,2,4...到threadSweepMax
+std::vector<std::pair<std::string, AppConfig>> makeThreadSweep( const AppConfig& config )
+{
+	std::vector<uint32_t> threadCounts = { 0 };
+	for (uint32_t threads = 1; threads < config.threadSweepMax; threads *= 2)
+	{
+		threadCounts.push_back( threads );
+	}
+	threadCounts.push_back( config.threadSweepMax );
+
+	std::vector<std::pair<std::string, AppConfig>> runs;
+	for (uint32_t threads : threadCounts)
+	{
+		AppConfig runConfig = config;
+		runConfig.recordThreads = threads;
+		runs.emplace_back( "t" + std::to_string( threads ), runConfig );
+	}
+	return runs;
+}
+
+//对象数1,10,100...到instanceSweepMax，每个数量分别用三种绘制模式各跑一次
+std::vector<std::pair<std::string, AppConfig>> makeInstanceSweep( const AppConfig& config )
+{
+	std::vector<uint32_t> objectCounts;
+	for (uint64_t count = 1; count < config.instanceSweepMax; count *= 10)//64位比较，乘10不会回绕
+	{
+		objectCounts.push_back( static_cast<uint32_t>(count) );
+	}
+	objectCounts.push_back( config.instanceSweepMax );
+
+	std::vector<std::pair<std::string, AppConfig>> runs;
+	for (uint32_t count : objectCounts)
+	{
+		for (DrawMode mode : { DrawMode::PerObject, DrawMode::Instanced, DrawMode::Indirect })
+		{
+			AppConfig runConfig = config;
+			runConfig.objectCount = count;
+			runConfig.drawMode = mode;
+			runs.emplace_back( std::string( drawModeName( mode ) ) + "_n" + std::to_string( count ), runConfig );
+		}
+	}
+	return runs;
+}
+
+//飞行帧数1到syncSweepMax，每个值分别用栅栏和时间线信号量各跑一次
+std::vector<std::pair<std::string, AppConfig>> makeSyncSweep( const AppConfig& config )
+{
+	std::vector<std::pair<std::string, AppConfig>> runs;
+	for (uint32_t framesInFlight = 1; framesInFlight <= config.syncSweepMax; framesInFlight++)
+	{
+		for (SyncMode mode : { SyncMode::Fence, SyncMode::Timeline })
+		{
+			AppConfig runConfig = config;
+			runConfig.framesInFlight = framesInFlight;
+			runConfig.syncMode = mode;
+			runs.emplace_back( std::string( mode == SyncMode::Timeline ? "timeline" : "fence" ) + "_f" + std::to_string( framesInFlight ), runConfig );
+		}
+	}
+	return runs;
+}
+
+std::vector<std::pair<std::string, AppConfig>> makePacingSweep( const AppConfig& config )
+{
+	std::vector<std::pair<std::string, AppConfig>> runs;
+	for (FramePacing pacing : { FramePacing::LowLatency, FramePacing::Balanced, FramePacing::MaxThroughput })
+	{
+		AppConfig runConfig = config;
+		runConfig.pacing = pacing;
+		runs.emplace_back( framePacingName( pacing ), runConfig );
+	}
+	return runs;
+}
+
+//渲染通道和动态渲染各跑一次，其余设置相同
+std::vector<std::pair<std::string, AppConfig>> makeRenderPathSweep( const AppConfig& config )
+{
+	std::vector<std::pair<std::string, AppConfig>> runs;
+	for (bool dynamicRendering : { false, true })
+	{
+		AppConfig runConfig = config;
+		runConfig.dynamicRendering = dynamicRendering;
+		runs.emplace_back( dynamicRendering ? "dynamic_rendering" : "render_pass", runConfig );
+	}
+	return runs;
+}
+
+int main( int argc, char* argv[] )
+{
+	AppConfig config;
+
+	try
+	{
+		config = parseCommandLine( argc, argv );
+		if (config.selfTest)
+		{
+			uint32_t failures = runAllocatorSelfTest() + runRenderGraphSelfTest();
+			return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+
+		Scene scene;
+		scene.mesh = config.gridSize > 0 ? makeGridMesh( config.gridSize ) : makeTriangleMesh();
+		scene.objects = makeObjectGrid( config.objectCount );
+
+		if (!config.writeAssetArchivePath.empty())
+		{
+			packAssets( config );
+		}
+		else if (config.threadSweepMax > 0)
+		{
+			runBenchmarkSweep( makeThreadSweep( config ), scene.mesh );
+		}
+		else if (config.instanceSweepMax > 0)
+		{
+			runBenchmarkSweep( makeInstanceSweep( config ), scene.mesh );
+		}
+		else if (config.syncSweepMax > 0)
+		{
+			runBenchmarkSweep( makeSyncSweep( config ), scene.mesh );
+		}
+		else if (config.pacingSweep)
+		{
+			runBenchmarkSweep( makePacingSweep( config ), scene.mesh );
+		}
+		else if (config.renderPathSweep)
+		{
+			runBenchmarkSweep( makeRenderPathSweep( config ), scene.mesh );
+		}
+		else
+		{
+			HelloTriangleApplication app( config, std::move( scene ) );
+			app.run();
+		}
 	}
 	catch (const std::exception& e)
 	{
 		std::cerr << e.what() << std::endl;
-		system( "pause" );
+		if (!config.headless)//CI上没有人按键
+		{
+			system( "pause" );
+		}
 		return EXIT_FAILURE;
 	}
-	system( "pause" );
+	if (!config.headless)
+	{
+		system( "pause" );
+	}
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// specialized per pipeline; alpha-blended variants output 0.5
+layout(constant_id = 1) const float OUTPUT_ALPHA = 1.0;
+
+layout(set = 1, binding = 1) uniform sampler2D textures[];
+
+// same block as bindless.vert; the range is visible to both stages
+layout(push_constant) uniform DrawConstants {
+    uint objectBuffer;
+    uint objectOffset;
+    uint texture; // placeholder index until the material texture is resident
+} draw;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = vec4(fragColor * texture(textures[draw.texture], fragTexCoord).rgb, OUTPUT_ALPHA);
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 0) uniform FrameConstants {
+    mat4 viewProj;
+    vec4 params;
+} frame;
+
+// every bindless buffer is read as an array of vec4
+layout(std430, set = 1, binding = 0) readonly buffer BindlessBuffer {
+    vec4 data[];
+} buffers[];
+
+layout(push_constant) uniform DrawConstants {
+    uint objectBuffer; // index into buffers[]
+    uint objectOffset; // in vec4s: four model matrix columns, then color
+    uint texture;      // index into textures[], read by bindless.frag
+} draw;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+void main() {
+    uint o = draw.objectOffset;
+    mat4 model = mat4(buffers[draw.objectBuffer].data[o], buffers[draw.objectBuffer].data[o + 1],
+                      buffers[draw.objectBuffer].data[o + 2], buffers[draw.objectBuffer].data[o + 3]);
+    vec4 color = buffers[draw.objectBuffer].data[o + 4];
+    gl_Position = frame.viewProj * model * vec4(inPosition, 0.0, 1.0);
+    fragTexCoord = inPosition + 0.5; // unit quad maps to [0, 1], larger meshes repeat
+    fragColor = inColor * color.rgb;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform FrameConstants {
+    mat4 viewProj;
+    vec4 params;
+} frame;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec4 instanceTransform; // xy: position, z: scale, w: rotation
+layout(location = 3) in vec4 instanceColor;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+void main() {
+    float c = cos(instanceTransform.w);
+    float s = sin(instanceTransform.w);
+    vec2 position = mat2(c, s, -s, c) * (inPosition * instanceTransform.z) + instanceTransform.xy;
+    gl_Position = frame.viewProj * vec4(position, 0.0, 1.0);
+    fragTexCoord = inPosition + 0.5; // unit quad maps to [0, 1], larger meshes repeat
+    fragColor = inColor * instanceColor.rgb;
+}
\ No newline at end of file
@@ -1,9 +1,15 @@
 #version 450
 
+// specialized per pipeline; alpha-blended variants output 0.5
+layout(constant_id = 1) const float OUTPUT_ALPHA = 1.0;
+
+layout(set = 0, binding = 2) uniform sampler2D texSampler; // white placeholder until the material texture is resident
+
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, OUTPUT_ALPHA);
 }
\ No newline at end of file
@@ -1,20 +1,33 @@
 #version 450
 
-layout(location = 0) out vec3 fragColor;
+layout(set = 0, binding = 0) uniform FrameConstants {
+    mat4 viewProj;
+    vec4 params;
+} frame;
+
+layout(set = 0, binding = 1) uniform ObjectConstants {
+    mat4 model;
+    vec4 color;
+} object;
+
+// specialized per pipeline; the unused branch is folded away
+layout(constant_id = 0) const bool OBJECT_PUSH_CONSTANTS = true;
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+layout(push_constant) uniform DrawConstants {
+    mat4 model;
+    vec4 color;
+} draw;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    mat4 model = OBJECT_PUSH_CONSTANTS ? draw.model : object.model;
+    vec4 color = OBJECT_PUSH_CONSTANTS ? draw.color : object.color;
+    gl_Position = frame.viewProj * model * vec4(inPosition, 0.0, 1.0);
+    fragTexCoord = inPosition + 0.5; // unit quad maps to [0, 1], larger meshes repeat
+    fragColor = inColor * color.rgb;
 }
\ No newline at end of file